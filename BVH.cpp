@@ -0,0 +1,215 @@
+#include "precomp.h"
+
+static bool containsBounds( const aabb &outer, const aabb &inner )
+{
+	for ( int i = 0; i < 3; i++ )
+	{
+		if ( inner.bmin[i] < outer.bmin[i] || inner.bmax[i] > outer.bmax[i] )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BVH::insert( Primitive *primitive )
+{
+	const aabb bounds = primitive->volume();
+	const float area = bounds.Area();
+
+	if ( head->isLeaf && head->primitives.empty() )
+	{
+		head = make_shared<BVHNode>( vector<Primitive *>( 1, primitive ) );
+		return;
+	}
+
+	// Branch and bound search for the sibling of the new leaf (Bittner et al. 2012)
+	// Placing the leaf next to a node grows that node and all of its ancestors, the growth of the
+	// ancestors is inherited by the children. A subtree can not be cheaper than inherited + area.
+	struct Candidate
+	{
+		const shared_ptr<BVHNode> *node;
+		float inherited;
+		int parent; // Index in visited, -1 for the head
+	};
+
+	auto worse = []( const pair<float, int> &a, const pair<float, int> &b ) { return a.first > b.first; };
+	priority_queue<pair<float, int>, vector<pair<float, int>>, decltype( worse )> queue( worse );
+	vector<Candidate> visited;
+
+	visited.push_back( {&head, 0.f, -1} );
+	queue.push( make_pair( area, 0 ) );
+
+	int best = 0;
+	float bestCost = FLT_MAX;
+
+	while ( !queue.empty() && queue.top().first < bestCost )
+	{
+		int index = queue.top().second;
+		queue.pop();
+
+		const Candidate c = visited[index];
+		const BVHNode &node = **c.node;
+		const float direct = aabb::Union( node.bounds, bounds ).Area();
+
+		if ( c.inherited + direct < bestCost )
+		{
+			best = index;
+			bestCost = c.inherited + direct;
+		}
+
+		const float inherited = c.inherited + direct - node.bounds.Area();
+		if ( !node.isLeaf && inherited + area < bestCost )
+		{
+			visited.push_back( {&node.left, inherited, index} );
+			queue.push( make_pair( inherited + area, (int)visited.size() - 1 ) );
+			visited.push_back( {&node.right, inherited, index} );
+			queue.push( make_pair( inherited + area, (int)visited.size() - 1 ) );
+		}
+	}
+
+	// Pair the sibling with the new leaf, then copy the path back up to the head
+	shared_ptr<BVHNode> leaf = make_shared<BVHNode>( vector<Primitive *>( 1, primitive ) );
+	shared_ptr<BVHNode> subtree = makeInterior( *visited[best].node, leaf );
+
+	for ( int child = best, parent = visited[best].parent; parent != -1; child = parent, parent = visited[parent].parent )
+	{
+		const BVHNode &node = **visited[parent].node;
+		subtree = &node.left == visited[child].node ? makeInterior( subtree, node.right ) : makeInterior( node.left, subtree );
+		subtree = rotate( subtree );
+	}
+
+	head = subtree;
+}
+
+bool BVH::remove( Primitive *primitive )
+{
+	bool found = false;
+	shared_ptr<BVHNode> result = removeFrom( head, primitive, nullptr, primitive->volume(), found );
+
+	if ( found )
+	{
+		head = result ? result : make_shared<BVHNode>( vector<Primitive *>() );
+	}
+
+	return found;
+}
+
+bool BVH::replace( Primitive *primitive, Primitive *replacement )
+{
+	bool found = false;
+	shared_ptr<BVHNode> result = removeFrom( head, primitive, replacement, primitive->volume(), found );
+
+	if ( found )
+	{
+		head = result;
+	}
+
+	return found;
+}
+
+shared_ptr<BVHNode> BVH::makeInterior( const shared_ptr<BVHNode> &left, const shared_ptr<BVHNode> &right )
+{
+	shared_ptr<BVHNode> node = make_shared<BVHNode>( vector<Primitive *>() );
+	node->isLeaf = false;
+	node->left = left;
+	node->right = right;
+	node->bounds = aabb::Union( left->bounds, right->bounds );
+	return node;
+}
+
+// Swaps a child with a grandchild on the other side when that shrinks the other side (Kensler 2008)
+// The bounds of the node itself do not change, so neither do the bounds of its ancestors.
+shared_ptr<BVHNode> BVH::rotate( const shared_ptr<BVHNode> &node )
+{
+	const shared_ptr<BVHNode> &l = node->left;
+	const shared_ptr<BVHNode> &r = node->right;
+
+	float bestGain = 0.f;
+	int bestRotation = -1;
+
+	if ( !r->isLeaf )
+	{
+		float gain = r->bounds.Area() - aabb::Union( l->bounds, r->right->bounds ).Area(); // l <-> r.left
+		if ( gain > bestGain ) bestGain = gain, bestRotation = 0;
+
+		gain = r->bounds.Area() - aabb::Union( r->left->bounds, l->bounds ).Area(); // l <-> r.right
+		if ( gain > bestGain ) bestGain = gain, bestRotation = 1;
+	}
+
+	if ( !l->isLeaf )
+	{
+		float gain = l->bounds.Area() - aabb::Union( r->bounds, l->right->bounds ).Area(); // r <-> l.left
+		if ( gain > bestGain ) bestGain = gain, bestRotation = 2;
+
+		gain = l->bounds.Area() - aabb::Union( l->left->bounds, r->bounds ).Area(); // r <-> l.right
+		if ( gain > bestGain ) bestGain = gain, bestRotation = 3;
+	}
+
+	switch ( bestRotation )
+	{
+	case 0:
+		return makeInterior( r->left, makeInterior( l, r->right ) );
+	case 1:
+		return makeInterior( r->right, makeInterior( r->left, l ) );
+	case 2:
+		return makeInterior( makeInterior( r, l->right ), l->left );
+	case 3:
+		return makeInterior( makeInterior( l->left, r ), l->right );
+	default:
+		return node;
+	}
+}
+
+// Returns the subtree without the primitive, or with the replacement in its place
+// nullptr when nothing is left of the subtree, the node itself when the primitive is not in it
+shared_ptr<BVHNode> BVH::removeFrom( const shared_ptr<BVHNode> &node, Primitive *primitive, Primitive *replacement, const aabb &bounds, bool &found )
+{
+	if ( !containsBounds( node->bounds, bounds ) )
+	{
+		return node;
+	}
+
+	if ( node->isLeaf )
+	{
+		vector<Primitive *> primitives = node->primitives;
+		vector<Primitive *>::iterator it = find( primitives.begin(), primitives.end(), primitive );
+
+		if ( it == primitives.end() )
+		{
+			return node;
+		}
+
+		found = true;
+
+		if ( replacement )
+		{
+			*it = replacement;
+		}
+		else
+		{
+			primitives.erase( it );
+			if ( primitives.empty() )
+			{
+				return nullptr;
+			}
+		}
+
+		return make_shared<BVHNode>( primitives );
+	}
+
+	shared_ptr<BVHNode> left = removeFrom( node->left, primitive, replacement, bounds, found );
+	if ( found )
+	{
+		// A removed leaf takes its parent with it, the sibling moves up
+		return left ? rotate( makeInterior( left, node->right ) ) : node->right;
+	}
+
+	shared_ptr<BVHNode> right = removeFrom( node->right, primitive, replacement, bounds, found );
+	if ( found )
+	{
+		return right ? rotate( makeInterior( node->left, right ) ) : node->left;
+	}
+
+	return node;
+}
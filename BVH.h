@@ -1,10 +1,11 @@
 #pragma once
 
-struct BVHNode
+// Nodes are shared between BVH copies, so a node is never modified once it is part of a tree that was copied
+struct BVHNode : public MemoryTracked<BVHNode, MEM_BVH>
 {
 	aabb bounds;
 	bool isLeaf;
-	BVHNode *left, *right;
+	shared_ptr<BVHNode> left, right;
 	vector<Primitive *> primitives;
 
 	BVHNode( vector<Primitive *> primitives ) : primitives( primitives )
@@ -19,12 +20,21 @@ struct BVHNode
 		{
 			bounds.Grow( primitives[i]->volume() );
 		}
+
+		memoryTracker.allocate( MEM_BVH, primitives.capacity() * sizeof( Primitive * ) );
 	}
 
-	void subdivide( int currentDepth )
+	~BVHNode()
+	{
+		memoryTracker.release( MEM_BVH, primitives.capacity() * sizeof( Primitive * ) );
+	}
+
+	BVHNode( const BVHNode & ) = delete;
+
+	void subdivide( int currentDepth, const BVHParameters &parameters )
 	{
 		// Conditions warrant a leaf node
-		if ( ( primitives.size() < 3 ) || ( currentDepth >= BVHDEPTH ) )
+		if ( ( (int)primitives.size() < parameters.leafSize ) || ( currentDepth >= parameters.maxDepth ) )
 		{
 			return;
 		}
@@ -36,7 +46,13 @@ struct BVHNode
 		int bestAxis = -1;
 		float bestSplit = FLT_MAX;
 		vector<Primitive *> leftPrims, rightPrims;
-		this->calculateSAH( bestAxis, bestSplit, leftPrims, rightPrims ); // currently bestAxis, bestSplit not used
+		this->calculateSAH( parameters, bestAxis, bestSplit, leftPrims, rightPrims ); // currently bestSplit not used
+
+		// No split is cheaper than the leaf
+		if ( bestAxis == -1 )
+		{
+			return;
+		}
 #else
 		// Split aabb on longest axis
 		int longestAxis = bounds.LongestAxis();
@@ -59,15 +75,16 @@ struct BVHNode
 		}
 #endif // USE_SAH
 
-		left = new BVHNode( leftPrims );
-		left->subdivide( currentDepth + 1 );
+		left = make_shared<BVHNode>( leftPrims );
+		left->subdivide( currentDepth + 1, parameters );
 
-		right = new BVHNode( rightPrims );
-		right->subdivide( currentDepth + 1 );
+		right = make_shared<BVHNode>( rightPrims );
+		right->subdivide( currentDepth + 1, parameters );
 
 		// We are no longer a leaf
 		isLeaf = false;
-		primitives.clear();
+		memoryTracker.release( MEM_BVH, primitives.capacity() * sizeof( Primitive * ) );
+		vector<Primitive *>().swap( primitives ); // clear() would keep the memory
 	}
 
 	Hit intersect( const Ray &r ) const
@@ -139,6 +156,111 @@ struct BVHNode
 		}
 	}
 
+	// Any hit closer than maxT, ignoring the primitive with id ignoreId (the light itself)
+	bool occluded( const Ray &r, float maxT, int ignoreId, int &occluderId ) const
+	{
+		if ( isLeaf )
+		{
+			for ( Primitive *p : primitives )
+			{
+				if ( p->id == ignoreId )
+				{
+					continue;
+				}
+
+				Hit h = p->hit( r );
+				if ( h.hitType != 0 && h.t < maxT )
+				{
+					occluderId = p->id;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// No need to find the closest hit, stop at the first child that is occluded
+		if ( rayIntersectsBounds( left->bounds, r ) && left->occluded( r, maxT, ignoreId, occluderId ) )
+		{
+			return true;
+		}
+
+		return rayIntersectsBounds( right->bounds, r ) && right->occluded( r, maxT, ignoreId, occluderId );
+	}
+
+	// occluded for the lanes of a packet, lanes that are occluded are cleared from active and get their occluder
+	// The box of a child is tested for all lanes at once, a lane that is the only one left continues on its own
+	void occluded4( const RayPacket4 &p, int ignoreId, int &active, int *occluderIds ) const
+	{
+		if ( isLeaf )
+		{
+			for ( Primitive *primitive : primitives )
+			{
+				if ( primitive->id == ignoreId )
+				{
+					continue;
+				}
+
+				for ( int lane = 0; lane < 4; lane++ )
+				{
+					if ( !( active & ( 1 << lane ) ) )
+					{
+						continue;
+					}
+
+					Hit h = primitive->hit( p.rays[lane] );
+					if ( h.hitType != 0 && h.t < p.maxT[lane] )
+					{
+						occluderIds[lane] = primitive->id;
+						active &= ~( 1 << lane );
+					}
+				}
+
+				if ( active == 0 )
+				{
+					return;
+				}
+			}
+			return;
+		}
+
+		for ( const BVHNode *child : {left.get(), right.get()} )
+		{
+			int lanes = active & packetIntersectsBounds( child->bounds, p );
+			const int traced = lanes;
+
+			if ( lanes & ( lanes - 1 ) )
+			{
+				child->occluded4( p, ignoreId, lanes, occluderIds );
+			}
+			else if ( lanes != 0 )
+			{
+				int lane = 0;
+				while ( !( lanes & ( 1 << lane ) ) )
+				{
+					lane++;
+				}
+
+				if ( child->occluded( p.rays[lane], p.maxT[lane], ignoreId, occluderIds[lane] ) )
+				{
+					lanes = 0;
+				}
+			}
+
+			active &= ~( traced & ~lanes );
+			if ( active == 0 )
+			{
+				return;
+			}
+		}
+	}
+
+	// Bytes used by this node and its children, nodes shared with other trees included
+	size_t memoryUsage() const
+	{
+		size_t bytes = sizeof( BVHNode ) + primitives.capacity() * sizeof( Primitive * );
+		return isLeaf ? bytes : bytes + left->memoryUsage() + right->memoryUsage();
+	}
+
 	// Debug BVH visualizer
 	vec3 debug( const Ray &r ) const
 	{
@@ -160,54 +282,59 @@ struct BVHNode
 		}
 	}
 
-  private:
 	// Based on Slab method, as described on https://tavianator.com/fast-branchless-raybounding-box-intersections/
-	inline bool rayIntersectsBounds( const aabb &bounds, const Ray &r ) const
+	static inline bool rayIntersectsBounds( const aabb &bounds, const Ray &r )
 	{
-#if 0
-		__m128 tmin4 = _mm_setr_ps( -FLT_MAX, -FLT_MAX, -FLT_MAX, 0 );
-		__m128 tmax4 = _mm_setr_ps( FLT_MAX, FLT_MAX, FLT_MAX, 0 );
-
-		__m128 rayOri = _mm_setr_ps( r.origin[0], r.origin[0], r.origin[0], 0.f );
-		__m128 rayDir = _mm_setr_ps( r.direction[0], r.direction[0], r.direction[0], 0.f );
-
-		__m128 t1_4 = _mm_div_ps( _mm_sub_ps( bounds.bmin4, rayOri ), rayDir );
-		__m128 t2_4 = _mm_div_ps( _mm_sub_ps( bounds.bmax4, rayOri ), rayDir );
+		// All three slabs at once, axes the ray is parallel to (and the unused fourth lane) are left out of
+		// the interval and instead require the origin to lie strictly between the planes
+		const __m128 parallel = _mm_or_ps( _mm_cmpeq_ps( r.direction.v4, _mm_setzero_ps() ), _mm_castsi128_ps( _mm_setr_epi32( 0, 0, 0, -1 ) ) );
+		const __m128 outside = _mm_or_ps( _mm_cmple_ps( r.origin.v4, bounds.bmin4 ), _mm_cmpge_ps( r.origin.v4, bounds.bmax4 ) );
+		if ( _mm_movemask_ps( _mm_and_ps( parallel, outside ) ) & 7 )
+		{
+			return false;
+		}
 
-		__m128 le_mask = _mm_cmpnle_ps( rayOri, bounds.bmin4 );
-		__m128 ge_mask = _mm_cmpnge_ps( rayOri, bounds.bmax4 );
+		const __m128 t1 = _mm_div_ps( _mm_sub_ps( bounds.bmin4, r.origin.v4 ), r.direction.v4 );
+		const __m128 t2 = _mm_div_ps( _mm_sub_ps( bounds.bmax4, r.origin.v4 ), r.direction.v4 );
 
-		tmin4 = _mm_max_ps( tmin4, _mm_min_ps( t1_4, t2_4 ) );
-		tmax4 = _mm_min_ps( tmax4, _mm_max_ps( t1_4, t2_4 ) );
+		__m128 tmin = _mm_or_ps( _mm_and_ps( parallel, _mm_set1_ps( -FLT_MAX ) ), _mm_andnot_ps( parallel, _mm_min_ps( t1, t2 ) ) );
+		__m128 tmax = _mm_or_ps( _mm_and_ps( parallel, _mm_set1_ps( FLT_MAX ) ), _mm_andnot_ps( parallel, _mm_max_ps( t1, t2 ) ) );
 
-		// TODO: Figure out how to check if masks contain a true value
-		// TODO: Figure out how to check last condition
+		tmin = _mm_max_ps( tmin, _mm_shuffle_ps( tmin, tmin, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		tmin = _mm_max_ps( tmin, _mm_shuffle_ps( tmin, tmin, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		tmax = _mm_min_ps( tmax, _mm_shuffle_ps( tmax, tmax, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		tmax = _mm_min_ps( tmax, _mm_shuffle_ps( tmax, tmax, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
 
-#else
-		float tmin = -FLT_MAX, tmax = FLT_MAX;
+		return _mm_comigt_ss( tmax, tmin ) && _mm_comigt_ss( tmax, _mm_setzero_ps() );
+	}
 
-		for ( int i = 0; i < 3; ++i )
-		{
-			if ( r.direction[i] != 0.0 )
-			{
-				// Optimization opportunity: precalculate inverse of directions
-				float t1 = ( bounds.bmin[i] - r.origin[i] ) / r.direction[i];
-				float t2 = ( bounds.bmax[i] - r.origin[i] ) / r.direction[i];
+	// rayIntersectsBounds for every lane of a packet, one bit per lane that hits
+	static inline int packetIntersectsBounds( const aabb &bounds, const RayPacket4 &p )
+	{
+		__m128 tmin = _mm_set1_ps( -FLT_MAX ), tmax = _mm_set1_ps( FLT_MAX ), miss = _mm_setzero_ps();
+		slab( bounds.bmin[0], bounds.bmax[0], p.origin.x, p.direction.x, tmin, tmax, miss );
+		slab( bounds.bmin[1], bounds.bmax[1], p.origin.y, p.direction.y, tmin, tmax, miss );
+		slab( bounds.bmin[2], bounds.bmax[2], p.origin.z, p.direction.z, tmin, tmax, miss );
 
-				tmin = max( tmin, min( t1, t2 ) );
-				tmax = min( tmax, max( t1, t2 ) );
-			}
-			else if ( r.origin[i] <= bounds.bmin[i] || r.origin[i] >= bounds.bmax[i] )
-			{
-				return false;
-			}
-		}
+		const __m128 hit = _mm_and_ps( _mm_cmpgt_ps( tmax, tmin ), _mm_cmpgt_ps( tmax, _mm_setzero_ps() ) );
+		return _mm_movemask_ps( _mm_andnot_ps( miss, hit ) );
+	}
 
-		return tmax > tmin && tmax > 0.0;
-#endif
+  private:
+	// One axis of packetIntersectsBounds, with the same handling of parallel rays as rayIntersectsBounds
+	static inline void slab( float bmin, float bmax, __m128 origin, __m128 direction, __m128 &tmin, __m128 &tmax, __m128 &miss )
+	{
+		const __m128 lo = _mm_set1_ps( bmin ), hi = _mm_set1_ps( bmax );
+		const __m128 parallel = _mm_cmpeq_ps( direction, _mm_setzero_ps() );
+		miss = _mm_or_ps( miss, _mm_and_ps( parallel, _mm_or_ps( _mm_cmple_ps( origin, lo ), _mm_cmpge_ps( origin, hi ) ) ) );
+
+		const __m128 t1 = _mm_div_ps( _mm_sub_ps( lo, origin ), direction );
+		const __m128 t2 = _mm_div_ps( _mm_sub_ps( hi, origin ), direction );
+		tmin = _mm_max_ps( tmin, _mm_or_ps( _mm_and_ps( parallel, _mm_set1_ps( -FLT_MAX ) ), _mm_andnot_ps( parallel, _mm_min_ps( t1, t2 ) ) ) );
+		tmax = _mm_min_ps( tmax, _mm_or_ps( _mm_and_ps( parallel, _mm_set1_ps( FLT_MAX ) ), _mm_andnot_ps( parallel, _mm_max_ps( t1, t2 ) ) ) );
 	}
 
-	void calculateSAH( int &bestAxis, float &bestSplit, vector<Primitive *> &bestLeftPrims, vector<Primitive *> &bestRightPrims )
+	void calculateSAH( const BVHParameters &parameters, int &bestAxis, float &bestSplit, vector<Primitive *> &bestLeftPrims, vector<Primitive *> &bestRightPrims )
 	{
 		float side1 = bounds.Extend( 0 );
 		float side2 = bounds.Extend( 1 );
@@ -215,7 +342,8 @@ struct BVHNode
 
 		// Calculate the cost of the head
 		float splitCost = FLT_MAX;
-		float minCost = primitives.size() * ( side1 * side2 + side2 * side3 + side3 * side1 );
+		float surface = side1 * side2 + side2 * side3 + side3 * side1;
+		float minCost = primitives.size() * surface;
 		float split;
 		float surfaceLeft, surfaceRight;
 		BVHNode *temp_left, *temp_right;
@@ -225,9 +353,9 @@ struct BVHNode
 		for ( int axis = 0; axis < 3; axis++ )
 		{
 			// Loop over all possible splits (primitive centroids)
-			for ( int bin = 1; bin < BINCOUNT; bin++ )
+			for ( int bin = 1; bin < parameters.binCount; bin++ )
 			{
-				split = bounds.bmin[axis] + bounds.Extend( axis ) * bin / BINCOUNT;
+				split = bounds.bmin[axis] + bounds.Extend( axis ) * bin / parameters.binCount;
 				primsLeft.clear();
 				primsRight.clear();
 
@@ -264,7 +392,8 @@ struct BVHNode
 				float rside3 = temp_right->bounds.Extend( 2 );
 
 				// Deallocate memory
-				delete temp_left, temp_right;
+				delete temp_left;
+				delete temp_right;
 				temp_left = nullptr;
 				temp_right = nullptr;
 
@@ -272,8 +401,8 @@ struct BVHNode
 				float surfaceLeft = lside1 * lside2 + lside2 * lside3 + lside3 * lside1;
 				float surfaceRight = rside1 * rside2 + rside2 * rside3 + rside3 * rside1;
 
-				// Calculate cost of split
-				splitCost = surfaceLeft * countLeft + surfaceRight * countRight;
+				// Calculate cost of split, the traversal step into the children is paid by every ray that hits this node
+				splitCost = parameters.traversalCost * surface + surfaceLeft * countLeft + surfaceRight * countRight;
 
 				// Is this split better than the current minimum?
 				if ( splitCost < minCost )
@@ -291,30 +420,82 @@ struct BVHNode
 	}
 };
 
+// Copying a BVH is cheap, the copy shares all nodes.
+// insert() and remove() copy the nodes on the path they change instead of modifying them (path copying),
+// so other copies, like the one in a published scene snapshot, are never affected by an edit.
 class BVH
 {
   public:
-	BVH( vector<Primitive *> primitives )
+	// Builds with the parameters tuned for this scene, or the defaults of Tuning
+	BVH( vector<Primitive *> primitives ) : BVH( primitives, tuning.forScene( primitives ) ) {}
+
+	BVH( vector<Primitive *> primitives, const BVHParameters &parameters ) : parameters( parameters )
 	{
 		constructBVH( primitives );
 	}
 
 	void constructBVH( vector<Primitive *> primitives )
 	{
-		head = new BVHNode( primitives );
-		head->subdivide( 0 );
+		PERF_SCOPE( PERF_BUILD );
+		head = make_shared<BVHNode>( primitives );
+		head->subdivide( 0, parameters );
 	}
 
+	// Adds a primitive without a rebuild, as a new leaf next to the node where it increases the surface area the least
+	void insert( Primitive *primitive );
+
+	// Removes a primitive without a rebuild, false when it is not in the BVH
+	// Uses the bounds of the primitive to find it, so it must not have changed since it was inserted
+	bool remove( Primitive *primitive );
+
+	// Puts a primitive with the same bounds in place of another one, e.g. after a material change
+	bool replace( Primitive *primitive, Primitive *replacement );
+
 	Hit intersect( const Ray &r ) const
 	{
 		return head->intersect( r );
 	}
 
+	bool occluded( const Ray &r, float maxT, int ignoreId, int &occluderId ) const
+	{
+		return head->occluded( r, maxT, ignoreId, occluderId );
+	}
+
+	// Returns the lanes of active that are occluded, a single active lane is traced as a plain ray
+	int occluded4( const RayPacket4 &p, int active, int ignoreId, int *occluderIds ) const
+	{
+		if ( ( active & ( active - 1 ) ) == 0 )
+		{
+			for ( int lane = 0; lane < 4; lane++ )
+			{
+				if ( active & ( 1 << lane ) )
+				{
+					return occluded( p.rays[lane], p.maxT[lane], ignoreId, occluderIds[lane] ) ? active : 0;
+				}
+			}
+			return 0;
+		}
+
+		int remaining = active;
+		head->occluded4( p, ignoreId, remaining, occluderIds );
+		return active & ~remaining;
+	}
+
 	vec3 debug( const Ray &r ) const
 	{
 		return head->debug( r );
 	}
 
+	size_t memoryUsage() const
+	{
+		return head->memoryUsage();
+	}
+
   private:
-	BVHNode *head;
+	shared_ptr<BVHNode> head;
+	BVHParameters parameters;
+
+	static shared_ptr<BVHNode> makeInterior( const shared_ptr<BVHNode> &left, const shared_ptr<BVHNode> &right );
+	static shared_ptr<BVHNode> rotate( const shared_ptr<BVHNode> &node );
+	static shared_ptr<BVHNode> removeFrom( const shared_ptr<BVHNode> &node, Primitive *primitive, Primitive *replacement, const aabb &bounds, bool &found );
 };
\ No newline at end of file
@@ -30,16 +30,41 @@ class Camera
 	}
 
 	Ray getRay( unsigned x, unsigned y ) const
+	{
+		const float lensAngle = RandomFloat(), lensRadius = RandomFloat();
+		const float jitterX = RandomFloat(), jitterY = RandomFloat();
+		return getRay( x, y, lensAngle, lensRadius, jitterX, jitterY );
+	}
+
+	// Same as getRay( x, y ), with the random numbers in [0, 1) from the caller
+	Ray getRay( unsigned x, unsigned y, float lensAngle, float lensRadius, float jitterX, float jitterY ) const
 	{
 		Ray r;
 
 		// Randomize origin for DoF
-		vec3 randVec = rotateVec( up, forward, Rand( 2 * PI ) );
-		r.origin = origin + randVec * Rand( aperture );
+		vec3 randVec = rotateVec( up, forward, lensAngle * 2 * PI );
+		r.origin = origin + randVec * ( lensRadius * aperture );
 
 		// Add some AA
-		float norm_x = ( ( float( x ) + ( -1.f + Rand( 1.f ) ) ) / float( SCRWIDTH ) ) - 0.5f;
-		float norm_y = ( ( float( y ) + ( -1.f + Rand( 1.f ) ) ) / float( SCRHEIGHT ) ) - 0.5f;
+		float norm_x = ( ( float( x ) + ( -1.f + jitterX ) ) / float( SCRWIDTH ) ) - 0.5f;
+		float norm_y = ( ( float( y ) + ( -1.f + jitterY ) ) / float( SCRHEIGHT ) ) - 0.5f;
+
+		vec3 imagePoint = norm_x * right * ( focusDistance * 0.5f ) * ( 1 / focalLength ) + norm_y * up * ( focusDistance * 0.5f ) * ( 1 / focalLength ) + origin + forward * focusDistance;
+
+		r.direction = imagePoint - r.origin;
+
+		return r;
+	}
+
+	// Ray through a continuous position on the image plane, without lens sampling or AA
+	// getRay( x, y ) with aperture 0 equals getPinholeRay( x + jitter, y + jitter ) with jitter in [-1, 0)
+	Ray getPinholeRay( float sx, float sy ) const
+	{
+		Ray r;
+		r.origin = origin;
+
+		float norm_x = ( sx / float( SCRWIDTH ) ) - 0.5f;
+		float norm_y = ( sy / float( SCRHEIGHT ) ) - 0.5f;
 
 		vec3 imagePoint = norm_x * right * ( focusDistance * 0.5f ) * ( 1 / focalLength ) + norm_y * up * ( focusDistance * 0.5f ) * ( 1 / focalLength ) + origin + forward * focusDistance;
 
@@ -88,6 +113,16 @@ class Camera
 		}
 	}
 
+	// True when both cameras generate the same primary rays
+	bool sameView( const Camera &other ) const
+	{
+		return origin.x == other.origin.x && origin.y == other.origin.y && origin.z == other.origin.z &&
+			   forward.x == other.forward.x && forward.y == other.forward.y && forward.z == other.forward.z &&
+			   up.x == other.up.x && up.y == other.up.y && up.z == other.up.z &&
+			   right.x == other.right.x && right.y == other.right.y && right.z == other.right.z &&
+			   aperture == other.aperture && focalLength == other.focalLength && focusDistance == other.focusDistance;
+	}
+
 	Ray focusRay()
 	{
 		Ray r;
@@ -106,8 +141,8 @@ class Camera
 	// Stack overflow: https://stackoverflow.com/questions/42421611/3d-vector-rotation-in-c
 	vec3 rotateVec( const vec3 &v, const vec3 &axis, float angle ) const
 	{
-		float cos_angle = cos( angle );
-		float sin_angle = sin( angle );
+		float sin_angle, cos_angle;
+		fastSinCos( angle, sin_angle, cos_angle );
 
 		vec3 rotated = ( v * cos_angle ) + ( axis.cross( v ) * sin_angle ) + ( axis * axis.dot( v ) ) * ( 1 - cos_angle );
 
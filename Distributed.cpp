@@ -0,0 +1,607 @@
+#include "precomp.h"
+
+#ifdef __linux__
+
+#define DISTRIBUTED_MAGIC 0x4c504d54u // Scene caches and HELLO messages start with it
+
+// Worker: HELLO, READY, RESULT. Coordinator: SETUP, WORK, DONE
+// A READY or RESULT asks for the next item, a worker without an item waits until an item is requeued or DONE
+enum MessageType
+{
+	MSG_HELLO,	// a magic, b and c the screen size
+	MSG_SETUP,	// a tile size, b seed, payload the camera and the scene cache path
+	MSG_READY,	// The scene is loaded
+	MSG_WORK,	// a tile, b first iteration, c iteration count
+	MSG_RESULT, // a, b and c of the item, payload the sum of the tile
+	MSG_DONE
+};
+
+struct MessageHeader
+{
+	uint type;
+	uint a, b, c;
+	uint payload; // Bytes following the header
+};
+
+#define CAMERA_FLOATS 17
+
+static void cameraToFloats( const Camera &cam, float *f )
+{
+	const vec3 vectors[4] = {cam.origin, cam.forward, cam.up, cam.right};
+	for ( int i = 0; i < 4; i++ )
+	{
+		f[i * 3 + 0] = vectors[i].x, f[i * 3 + 1] = vectors[i].y, f[i * 3 + 2] = vectors[i].z;
+	}
+	f[12] = cam.width, f[13] = cam.height, f[14] = cam.aperture, f[15] = cam.focalLength, f[16] = cam.focusDistance;
+}
+
+static Camera cameraFromFloats( const float *f )
+{
+	Camera cam;
+	cam.origin = vec3( f[0], f[1], f[2] );
+	cam.forward = vec3( f[3], f[4], f[5] );
+	cam.up = vec3( f[6], f[7], f[8] );
+	cam.right = vec3( f[9], f[10], f[11] );
+	cam.width = f[12], cam.height = f[13], cam.aperture = f[14], cam.focalLength = f[15], cam.focusDistance = f[16];
+	return cam;
+}
+
+static bool sendAll( int socket, const void *data, size_t bytes )
+{
+	const char *p = (const char *)data;
+	while ( bytes > 0 )
+	{
+		const ssize_t sent = send( socket, p, bytes, MSG_NOSIGNAL );
+		if ( sent <= 0 )
+		{
+			return false;
+		}
+		p += sent, bytes -= sent;
+	}
+	return true;
+}
+
+static bool receiveAll( int socket, void *data, size_t bytes )
+{
+	char *p = (char *)data;
+	while ( bytes > 0 )
+	{
+		const ssize_t received = recv( socket, p, bytes, 0 );
+		if ( received <= 0 )
+		{
+			return false;
+		}
+		p += received, bytes -= received;
+	}
+	return true;
+}
+
+static bool sendMessage( int socket, uint type, uint a = 0, uint b = 0, uint c = 0, const void *payload = nullptr, size_t bytes = 0 )
+{
+	const MessageHeader header = {type, a, b, c, (uint)bytes};
+	return sendAll( socket, &header, sizeof( header ) ) && ( bytes == 0 || sendAll( socket, payload, bytes ) );
+}
+
+static size_t tilePixels( const Renderer &renderer, int tile )
+{
+	int x0, y0, x1, y1;
+	renderer.getTileBounds( tile, x0, y0, x1, y1 );
+	return size_t( x1 - x0 ) * size_t( y1 - y0 );
+}
+
+// Scene cache
+
+static void writeFloats( ofstream &out, const float *f, int count )
+{
+	out.write( (const char *)f, sizeof( float ) * count );
+}
+
+static void writeVec3( ofstream &out, const vec3 &v )
+{
+	const float f[3] = {v.x, v.y, v.z};
+	writeFloats( out, f, 3 );
+}
+
+static vec3 readVec3( ifstream &in )
+{
+	float f[3] = {0.f, 0.f, 0.f};
+	in.read( (char *)f, sizeof( f ) );
+	return vec3( f[0], f[1], f[2] );
+}
+
+// Magic and primitive count, then per primitive its kind (0 sphere, 1 triangle), material and geometry
+bool saveSceneCache( const char *filename, const vector<Primitive *> &primitives )
+{
+	ofstream out( filename, ios::binary );
+	if ( !out )
+	{
+		return false;
+	}
+
+	uint count = 0;
+	for ( Primitive *p : primitives )
+	{
+		count += p != nullptr;
+	}
+	const uint header[2] = {DISTRIBUTED_MAGIC, count};
+	out.write( (const char *)header, sizeof( header ) );
+
+	for ( Primitive *p : primitives )
+	{
+		if ( !p )
+		{
+			continue; // Removed
+		}
+		if ( p->mat.hasDiffuse() )
+		{
+			return false;
+		}
+
+		const Sphere *sphere = dynamic_cast<const Sphere *>( p );
+		const Triangle *triangle = dynamic_cast<const Triangle *>( p );
+		if ( !sphere && !triangle )
+		{
+			return false;
+		}
+
+		const int kind[2] = {sphere ? 0 : 1, (int)p->mat.type};
+		out.write( (const char *)kind, sizeof( kind ) );
+		writeVec3( out, p->mat.albedo );
+		writeVec3( out, p->mat.emission );
+
+		if ( sphere )
+		{
+			writeVec3( out, sphere->origin );
+			writeFloats( out, &sphere->radius, 1 );
+		}
+		else
+		{
+			writeVec3( out, triangle->v0 );
+			writeVec3( out, triangle->v1 );
+			writeVec3( out, triangle->v2 );
+			const float uv[6] = {triangle->uv0.x, triangle->uv0.y, triangle->uv1.x, triangle->uv1.y, triangle->uv2.x, triangle->uv2.y};
+			writeFloats( out, uv, 6 );
+		}
+	}
+
+	return (bool)out;
+}
+
+// The primitives are only taken over when the whole file can be read
+bool loadSceneCache( const char *filename, vector<Primitive *> &primitives )
+{
+	ifstream in( filename, ios::binary );
+	uint header[2] = {0, 0};
+	if ( !in.read( (char *)header, sizeof( header ) ) || header[0] != DISTRIBUTED_MAGIC )
+	{
+		return false;
+	}
+
+	vector<Primitive *> loaded;
+	for ( uint i = 0; i < header[1] && in; i++ )
+	{
+		int kind[2] = {-1, 0};
+		in.read( (char *)kind, sizeof( kind ) );
+
+		Material mat;
+		mat.type = (MaterialType)kind[1];
+		mat.albedo = readVec3( in );
+		mat.emission = readVec3( in );
+
+		if ( kind[0] == 0 )
+		{
+			const vec3 origin = readVec3( in );
+			float radius = 0.f;
+			in.read( (char *)&radius, sizeof( radius ) );
+			loaded.push_back( new Sphere( origin, radius, mat ) );
+		}
+		else if ( kind[0] == 1 )
+		{
+			vec3 verts[3];
+			for ( vec3 &v : verts )
+			{
+				v = readVec3( in );
+			}
+			float f[6] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+			in.read( (char *)f, sizeof( f ) );
+			vec2 uv[3] = {vec2( f[0], f[1] ), vec2( f[2], f[3] ), vec2( f[4], f[5] )};
+			loaded.push_back( new Triangle( mat, verts, uv ) );
+		}
+		else
+		{
+			in.setstate( ios::failbit );
+		}
+	}
+
+	if ( !in )
+	{
+		for ( Primitive *p : loaded )
+		{
+			delete p;
+		}
+		return false;
+	}
+
+	primitives = loaded;
+	return true;
+}
+
+// Coordinator
+
+Coordinator::Coordinator( Renderer &renderer, const string &sceneCache, unsigned seed, unsigned spp )
+	: renderer( renderer ), sceneCache( sceneCache ), seed( seed ), listener( -1 ), mergedCount( 0 )
+{
+	const int tileCount = renderer.getTileCount();
+	for ( unsigned first = 0; first < spp; first += DISTRIBUTEDITERATIONS )
+	{
+		for ( int tile = 0; tile < tileCount; tile++ )
+		{
+			queue.push_back( {tile, first, min( spp - first, (unsigned)DISTRIBUTEDITERATIONS )} );
+		}
+	}
+	itemCount = queue.size();
+
+	nextIteration.assign( tileCount, 0 );
+	early.resize( tileCount );
+
+	// Workers may run in another directory
+	char *path = realpath( sceneCache.c_str(), nullptr );
+	if ( path )
+	{
+		this->sceneCache = path;
+		free( path );
+	}
+}
+
+Coordinator::~Coordinator()
+{
+	for ( Worker &worker : workers )
+	{
+		close( worker.socket );
+	}
+	if ( listener >= 0 )
+	{
+		close( listener );
+	}
+}
+
+bool Coordinator::listen( int port )
+{
+	listener = socket( AF_INET, SOCK_STREAM, 0 );
+	const int reuse = 1;
+	setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( (uint16_t)port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	if ( listener < 0 || bind( listener, (sockaddr *)&address, sizeof( address ) ) != 0 || ::listen( listener, 16 ) != 0 )
+	{
+		if ( listener >= 0 )
+		{
+			close( listener );
+		}
+		listener = -1;
+		return false;
+	}
+	return true;
+}
+
+bool Coordinator::update( int timeout )
+{
+	if ( mergedCount < itemCount )
+	{
+		vector<pollfd> fds( workers.size() + 1 );
+		for ( size_t i = 0; i < workers.size(); i++ )
+		{
+			fds[i].fd = workers[i].socket;
+			fds[i].events = POLLIN;
+		}
+		fds.back().fd = listener;
+		fds.back().events = POLLIN;
+
+		const bool ready = poll( fds.data(), fds.size(), timeout ) > 0;
+
+		// Back to front, so dropping a worker leaves the indices still to visit alone
+		// A worker that does not answer in time hangs, or its machine does, its item goes to another worker
+		for ( size_t i = workers.size(); i-- > 0; )
+		{
+			Worker &worker = workers[i];
+			bool keep = worker.socket >= 0 && ( !ready || !fds[i].revents || receive( worker ) );
+			if ( keep && worker.state != WORKER_IDLE && worker.waiting.elapsed() > DISTRIBUTEDTIMEOUT * 1000.f )
+			{
+				keep = false;
+			}
+			if ( !keep )
+			{
+				drop( i );
+			}
+		}
+
+		if ( ready && ( fds.back().revents & POLLIN ) )
+		{
+			accept();
+		}
+
+		// Items of workers that left go to the workers that wait
+		for ( Worker &worker : workers )
+		{
+			if ( worker.state == WORKER_IDLE && worker.socket >= 0 )
+			{
+				assign( worker );
+			}
+		}
+	}
+
+	if ( mergedCount < itemCount )
+	{
+		return true;
+	}
+
+	for ( Worker &worker : workers )
+	{
+		sendMessage( worker.socket, MSG_DONE );
+		close( worker.socket );
+	}
+	workers.clear();
+	return false;
+}
+
+int Coordinator::getWorkerCount() const
+{
+	return (int)workers.size();
+}
+
+float Coordinator::getProgress() const
+{
+	return itemCount > 0 ? float( mergedCount ) / float( itemCount ) : 1.f;
+}
+
+void Coordinator::accept()
+{
+	const int socket = ::accept( listener, nullptr, nullptr );
+	if ( socket < 0 )
+	{
+		return;
+	}
+
+	const int noDelay = 1;
+	setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+
+	// Waits for its HELLO before it gets anything
+	Worker worker;
+	worker.socket = socket;
+	worker.state = WORKER_HELLO;
+	worker.item = {-1, 0, 0};
+	workers.push_back( worker );
+}
+
+// Takes what has arrived without waiting for the rest of a message, and handles the complete messages
+// False when the worker has to go: it disconnected, or sent something it should not have
+bool Coordinator::receive( Worker &worker )
+{
+	char buffer[1 << 16];
+	for ( ;; )
+	{
+		const ssize_t received = recv( worker.socket, buffer, sizeof( buffer ), MSG_DONTWAIT );
+		if ( received > 0 )
+		{
+			worker.inbox.insert( worker.inbox.end(), buffer, buffer + received );
+		}
+		else if ( received == 0 || ( errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK ) )
+		{
+			return false;
+		}
+		else if ( errno != EINTR )
+		{
+			break;
+		}
+	}
+
+	// No message is larger than the result of a whole tile, tile 0 is never clipped by the screen edge
+	const size_t maxPayload = tilePixels( renderer, 0 ) * sizeof( vec3 );
+
+	size_t used = 0;
+	MessageHeader header;
+	while ( worker.inbox.size() - used >= sizeof( header ) )
+	{
+		memcpy( &header, worker.inbox.data() + used, sizeof( header ) );
+		if ( header.payload > maxPayload )
+		{
+			return false;
+		}
+		if ( worker.inbox.size() - used - sizeof( header ) < header.payload )
+		{
+			break;
+		}
+		if ( !handle( worker, header, worker.inbox.data() + used + sizeof( header ) ) )
+		{
+			return false;
+		}
+		used += sizeof( header ) + header.payload;
+	}
+
+	worker.inbox.erase( worker.inbox.begin(), worker.inbox.begin() + used );
+	return true;
+}
+
+// Every message is only valid in one state of the worker
+bool Coordinator::handle( Worker &worker, const MessageHeader &header, const char *payload )
+{
+	switch ( header.type )
+	{
+	case MSG_HELLO:
+	{
+		if ( worker.state != WORKER_HELLO || header.a != DISTRIBUTED_MAGIC || header.b != SCRWIDTH || header.c != SCRHEIGHT || header.payload != 0 )
+		{
+			return false;
+		}
+
+		int x0, y0, x1, y1;
+		renderer.getTileBounds( 0, x0, y0, x1, y1 );
+		vector<char> setup( CAMERA_FLOATS * sizeof( float ) + sceneCache.size() );
+		cameraToFloats( *renderer.getCamera(), (float *)setup.data() );
+		memcpy( setup.data() + CAMERA_FLOATS * sizeof( float ), sceneCache.data(), sceneCache.size() );
+		worker.state = WORKER_LOADING;
+		worker.waiting.reset();
+		return sendMessage( worker.socket, MSG_SETUP, x1 - x0, seed, 0, setup.data(), setup.size() );
+	}
+	case MSG_READY:
+		if ( worker.state != WORKER_LOADING || header.payload != 0 )
+		{
+			return false;
+		}
+		worker.state = WORKER_IDLE;
+		return true;
+	case MSG_RESULT:
+	{
+		// Only the item the worker is rendering, so no item is merged twice
+		const WorkItem &item = worker.item;
+		if ( worker.state != WORKER_BUSY || item.tile < 0 || (int)header.a != item.tile || header.b != item.first || header.c != item.count ||
+			 header.payload != tilePixels( renderer, item.tile ) * sizeof( vec3 ) )
+		{
+			return false;
+		}
+
+		vector<vec3> sum( header.payload / sizeof( vec3 ) );
+		memcpy( sum.data(), payload, header.payload );
+		worker.state = WORKER_IDLE;
+		merge( item, sum );
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Sums are added in iteration order, so the result does not depend on the order they arrive in
+void Coordinator::merge( const WorkItem &item, vector<vec3> &sum )
+{
+	mergedCount++;
+	if ( item.first != nextIteration[item.tile] )
+	{
+		early[item.tile][item.first] = make_pair( item.count, move( sum ) );
+		return;
+	}
+
+	renderer.addTileSamples( item.tile, item.count, sum.data() );
+	nextIteration[item.tile] += item.count;
+
+	map<unsigned, pair<unsigned, vector<vec3>>> &waiting = early[item.tile];
+	for ( auto next = waiting.find( nextIteration[item.tile] ); next != waiting.end(); next = waiting.find( nextIteration[item.tile] ) )
+	{
+		renderer.addTileSamples( item.tile, next->second.first, next->second.second.data() );
+		nextIteration[item.tile] += next->second.first;
+		waiting.erase( next );
+	}
+}
+
+void Coordinator::assign( Worker &worker )
+{
+	if ( queue.empty() )
+	{
+		return;
+	}
+
+	worker.item = queue.front();
+	if ( sendMessage( worker.socket, MSG_WORK, worker.item.tile, worker.item.first, worker.item.count ) )
+	{
+		queue.pop_front();
+		worker.state = WORKER_BUSY;
+		worker.waiting.reset();
+	}
+	else
+	{
+		// Dropped by the next update
+		close( worker.socket );
+		worker.socket = -1;
+	}
+}
+
+void Coordinator::drop( size_t index )
+{
+	Worker &worker = workers[index];
+	if ( worker.state == WORKER_BUSY )
+	{
+		queue.push_front( worker.item );
+	}
+	if ( worker.socket >= 0 )
+	{
+		close( worker.socket );
+	}
+	workers.erase( workers.begin() + index );
+}
+
+// Worker
+
+bool runWorker( const char *host, int port, unsigned leaveAfter )
+{
+	const int socket = ::socket( AF_INET, SOCK_STREAM, 0 );
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( (uint16_t)port );
+
+	if ( socket < 0 || inet_pton( AF_INET, host, &address.sin_addr ) != 1 || connect( socket, (sockaddr *)&address, sizeof( address ) ) != 0 )
+	{
+		if ( socket >= 0 )
+		{
+			close( socket );
+		}
+		return false;
+	}
+
+	const int noDelay = 1;
+	setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+
+	MessageHeader header;
+	vector<char> setup;
+	if ( !sendMessage( socket, MSG_HELLO, DISTRIBUTED_MAGIC, SCRWIDTH, SCRHEIGHT ) || !receiveAll( socket, &header, sizeof( header ) ) ||
+		 header.type != MSG_SETUP || header.payload < CAMERA_FLOATS * sizeof( float ) )
+	{
+		close( socket );
+		return false;
+	}
+
+	setup.resize( header.payload );
+	vector<Primitive *> primitives;
+	const size_t cameraBytes = CAMERA_FLOATS * sizeof( float );
+	if ( !receiveAll( socket, setup.data(), setup.size() ) || !loadSceneCache( string( setup.data() + cameraBytes, setup.size() - cameraBytes ).c_str(), primitives ) )
+	{
+		close( socket );
+		return false;
+	}
+
+	// The tile size decides the tiles and their seeds, so it has to be the coordinator's
+	tuning.tileSize = header.a;
+	Renderer renderer( primitives );
+	renderer.setCamera( cameraFromFloats( (const float *)setup.data() ) );
+	renderer.setSeed( header.b );
+
+	bool ok = sendMessage( socket, MSG_READY );
+	vector<vec3> sum;
+	for ( unsigned items = 0; ok; items++ )
+	{
+		ok = receiveAll( socket, &header, sizeof( header ) ) && ( header.type == MSG_WORK || header.type == MSG_DONE );
+		if ( !ok || header.type == MSG_DONE || items == leaveAfter )
+		{
+			break;
+		}
+
+		const int tile = (int)header.a;
+		ok = tile >= 0 && tile < renderer.getTileCount();
+		if ( ok )
+		{
+			sum.resize( tilePixels( renderer, tile ) );
+			renderer.renderTileSamples( tile, header.b, header.c, sum.data() );
+			ok = sendMessage( socket, MSG_RESULT, header.a, header.b, header.c, sum.data(), sum.size() * sizeof( vec3 ) );
+		}
+	}
+
+	close( socket );
+	return ok;
+}
+
+#endif
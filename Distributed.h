@@ -0,0 +1,86 @@
+#pragma once
+
+// Rendering the tiles of a frame in worker processes, over TCP on this machine
+// The coordinator splits spp iterations of every tile into work items of DISTRIBUTEDITERATIONS iterations.
+// A worker pulls an item, renders it with Renderer::renderTileSamples and sends the float sum of the tile back,
+// which the coordinator adds to its own renderer. Items are seeded by tile and iteration, and the sums of a tile are
+// merged in iteration order, so the image does not depend on how many workers there were or which one rendered what.
+// Workers may connect at any time. The item of a worker that disconnects, or that does not answer within
+// DISTRIBUTEDTIMEOUT seconds, goes back to the queue. The coordinator never waits for a worker that is slow to send.
+// Workers load the scene from a binary scene cache written by the coordinator, all processes must be the same build.
+
+#ifdef __linux__
+
+struct MessageHeader;
+
+// Spheres and triangles with their materials, textures are not stored so saving a textured scene fails
+bool saveSceneCache( const char *filename, const vector<Primitive *> &primitives );
+bool loadSceneCache( const char *filename, vector<Primitive *> &primitives );
+
+class Coordinator
+{
+  public:
+	// Renders spp iterations of the scene cache into the renderer, which must hold the same scene
+	Coordinator( Renderer &renderer, const string &sceneCache, unsigned seed, unsigned spp );
+	~Coordinator();
+
+	// Listens on 127.0.0.1, false when the port is taken
+	bool listen( int port );
+
+	// Accepts workers, hands out items and merges results for at most timeout ms
+	// False once every item is merged, the workers have been told to stop then
+	bool update( int timeout );
+
+	int getWorkerCount() const;
+	float getProgress() const; // Merged items out of all items
+
+  private:
+	struct WorkItem
+	{
+		int tile;
+		unsigned first, count;
+	};
+
+	enum WorkerState
+	{
+		WORKER_HELLO,	// Connected, its HELLO has not arrived yet
+		WORKER_LOADING, // Sent SETUP, its READY has not arrived yet
+		WORKER_IDLE,	// Waiting for an item
+		WORKER_BUSY		// Rendering item
+	};
+
+	struct Worker
+	{
+		int socket;
+		WorkerState state;
+		WorkItem item;
+		timer waiting;		// Since the worker was last asked for something, not counted while idle
+		vector<char> inbox; // Received bytes of messages that are not complete yet
+	};
+
+	Renderer &renderer;
+	string sceneCache;
+	unsigned seed;
+	int listener;
+
+	deque<WorkItem> queue; // Iteration major, so the image converges evenly while workers come and go
+	vector<Worker> workers;
+	size_t itemCount, mergedCount;
+
+	// Per tile the next iteration to merge, and the sums that arrived before it by first iteration
+	vector<unsigned> nextIteration;
+	vector<map<unsigned, pair<unsigned, vector<vec3>>>> early;
+
+	void accept();
+	bool receive( Worker &worker );
+	bool handle( Worker &worker, const MessageHeader &header, const char *payload );
+	void merge( const WorkItem &item, vector<vec3> &sum );
+	void assign( Worker &worker );
+	void drop( size_t index );
+};
+
+// Connects to the coordinator and renders items until it is done
+// With leaveAfter the worker leaves without a word on the item after that many, to test coordinators
+bool runWorker( const char *host, int port, unsigned leaveAfter = UINT_MAX );
+
+#endif
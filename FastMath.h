@@ -0,0 +1,170 @@
+#pragma once
+
+// Polynomial approximations of the trigonometric functions on the sampling paths, for one float, four (SSE)
+// and, when compiled with AVX2, eight lanes. Every form runs the same operations in the same order as the scalar one.
+// The coefficients are the single precision minimax fits of Cephes. The bounds below are the maximum absolute
+// errors against double precision over the valid range, bench fastmath checks them.
+// Square roots are left to sqrtf / _mm_sqrt_ps, which are exact and already a single instruction.
+
+#define FASTMATH_SINCOS_ERROR 1.5e-7f // |x| < FASTMATH_SINCOS_RANGE
+#define FASTMATH_SINCOS_RANGE 8192.f  // The reduction by multiples of pi / 2 loses precision beyond this
+#define FASTMATH_ATAN2_ERROR 3.5e-7f
+#define FASTMATH_ASIN_ERROR 2.5e-7f // |x| <= 1
+
+// x = q * pi / 2 + r with |r| <= pi / 4, pi / 2 split in three parts so q * part is exact
+#define FASTMATH_PIO2_1 1.5703125f
+#define FASTMATH_PIO2_2 4.837512969970703125e-4f
+#define FASTMATH_PIO2_3 7.54978995489188216e-8f
+
+inline float fastSinPoly( float r, float r2 ) { return r + r * r2 * ( -1.6666654611e-1f + r2 * ( 8.3321608736e-3f + r2 * -1.9515295891e-4f ) ); }
+inline float fastCosPoly( float r2 ) { return 1.f - 0.5f * r2 + r2 * r2 * ( 4.166664568298827e-2f + r2 * ( -1.388731625493765e-3f + r2 * 2.443315711809948e-5f ) ); }
+inline float fastAtanPoly( float u, float u2 ) { return ( ( ( 8.05374449538e-2f * u2 - 1.38776856032e-1f ) * u2 + 1.99777106478e-1f ) * u2 - 3.33329491539e-1f ) * u2 * u + u; }
+inline float fastAsinPoly( float s, float z ) { return ( ( ( ( 4.2163199048e-2f * z + 2.4181311049e-2f ) * z + 4.5470025998e-2f ) * z + 7.4953002686e-2f ) * z + 1.6666752422e-1f ) * z * s + s; }
+
+inline void fastSinCos( float x, float &s, float &c )
+{
+	// Round to nearest like _mm_cvtps_epi32
+	const int q = _mm_cvtss_si32( _mm_set_ss( x * 0.636619772f ) );
+	const float j = float( q );
+	const float r = ( ( x - j * FASTMATH_PIO2_1 ) - j * FASTMATH_PIO2_2 ) - j * FASTMATH_PIO2_3;
+	const float r2 = r * r;
+	const float sr = fastSinPoly( r, r2 ), cr = fastCosPoly( r2 );
+
+	// sin( q * pi / 2 + r ) and cos( q * pi / 2 + r ) per quadrant
+	s = q & 1 ? cr : sr;
+	c = q & 1 ? sr : cr;
+	s = q & 2 ? -s : s;
+	c = ( q + 1 ) & 2 ? -c : c;
+}
+
+inline float fastAtan2( float y, float x )
+{
+	const float ax = fabsf( x ), ay = fabsf( y );
+	const float hi = max( ax, ay ), lo = min( ax, ay );
+	const float t = hi > 0.f ? lo / hi : 0.f;
+
+	// atan( t ) = pi / 4 + atan( ( t - 1 ) / ( t + 1 ) ) keeps the polynomial within tan( pi / 8 )
+	const bool shifted = t > 0.414213562f;
+	const float u = shifted ? ( t - 1.f ) / ( t + 1.f ) : t;
+	float r = ( shifted ? 0.785398163f : 0.f ) + fastAtanPoly( u, u * u );
+
+	r = ay > ax ? 1.570796327f - r : r;
+	r = signbit( x ) ? 3.141592654f - r : r;
+	return copysignf( r, y );
+}
+
+inline float fastAsin( float x )
+{
+	// asin( a ) = pi / 2 - 2 asin( sqrt( ( 1 - a ) / 2 ) ) for a > 1 / 2
+	const float a = fabsf( x );
+	const bool reflected = a > 0.5f;
+	const float z = reflected ? 0.5f * ( 1.f - a ) : a * a;
+	const float p = fastAsinPoly( reflected ? sqrtf( z ) : a, z );
+	return copysignf( reflected ? 1.570796327f - 2.f * p : p, x );
+}
+
+inline __m128 fastSelect( const __m128 mask, const __m128 a, const __m128 b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }
+
+inline void fastSinCos( const __m128 x, __m128 &s, __m128 &c )
+{
+	const __m128i q = _mm_cvtps_epi32( _mm_mul_ps( x, _mm_set1_ps( 0.636619772f ) ) );
+	const __m128 j = _mm_cvtepi32_ps( q );
+	const __m128 r = _mm_sub_ps( _mm_sub_ps( _mm_sub_ps( x, _mm_mul_ps( j, _mm_set1_ps( FASTMATH_PIO2_1 ) ) ), _mm_mul_ps( j, _mm_set1_ps( FASTMATH_PIO2_2 ) ) ), _mm_mul_ps( j, _mm_set1_ps( FASTMATH_PIO2_3 ) ) );
+	const __m128 r2 = _mm_mul_ps( r, r );
+
+	const __m128 sr = _mm_add_ps( r, _mm_mul_ps( _mm_mul_ps( r, r2 ), _mm_add_ps( _mm_set1_ps( -1.6666654611e-1f ), _mm_mul_ps( r2, _mm_add_ps( _mm_set1_ps( 8.3321608736e-3f ), _mm_mul_ps( r2, _mm_set1_ps( -1.9515295891e-4f ) ) ) ) ) ) );
+	const __m128 cr = _mm_add_ps( _mm_sub_ps( _mm_set1_ps( 1.f ), _mm_mul_ps( _mm_set1_ps( 0.5f ), r2 ) ),
+								  _mm_mul_ps( _mm_mul_ps( r2, r2 ), _mm_add_ps( _mm_set1_ps( 4.166664568298827e-2f ), _mm_mul_ps( r2, _mm_add_ps( _mm_set1_ps( -1.388731625493765e-3f ), _mm_mul_ps( r2, _mm_set1_ps( 2.443315711809948e-5f ) ) ) ) ) ) );
+
+	const __m128 odd = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( q, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 1 ) ) );
+	const __m128 sinSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( q, _mm_set1_epi32( 2 ) ), 30 ) );
+	const __m128 cosSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( _mm_add_epi32( q, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 2 ) ), 30 ) );
+
+	s = _mm_xor_ps( fastSelect( odd, cr, sr ), sinSign );
+	c = _mm_xor_ps( fastSelect( odd, sr, cr ), cosSign );
+}
+
+inline __m128 fastAtan2( const __m128 y, const __m128 x )
+{
+	const __m128 signMask = _mm_set1_ps( -0.f );
+	const __m128 ax = _mm_andnot_ps( signMask, x ), ay = _mm_andnot_ps( signMask, y );
+	const __m128 hi = _mm_max_ps( ax, ay ), lo = _mm_min_ps( ax, ay );
+	const __m128 t = _mm_and_ps( _mm_cmpgt_ps( hi, _mm_setzero_ps() ), _mm_div_ps( lo, hi ) );
+
+	const __m128 one = _mm_set1_ps( 1.f );
+	const __m128 shifted = _mm_cmpgt_ps( t, _mm_set1_ps( 0.414213562f ) );
+	const __m128 u = fastSelect( shifted, _mm_div_ps( _mm_sub_ps( t, one ), _mm_add_ps( t, one ) ), t );
+	const __m128 u2 = _mm_mul_ps( u, u );
+	const __m128 p = _mm_add_ps( _mm_mul_ps( _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( 8.05374449538e-2f ), u2 ), _mm_set1_ps( 1.38776856032e-1f ) ), u2 ), _mm_set1_ps( 1.99777106478e-1f ) ), u2 ), _mm_set1_ps( 3.33329491539e-1f ) ), u2 ), u ), u );
+	__m128 r = _mm_add_ps( _mm_and_ps( shifted, _mm_set1_ps( 0.785398163f ) ), p );
+
+	r = fastSelect( _mm_cmpgt_ps( ay, ax ), _mm_sub_ps( _mm_set1_ps( 1.570796327f ), r ), r );
+	r = fastSelect( _mm_castsi128_ps( _mm_srai_epi32( _mm_castps_si128( x ), 31 ) ), _mm_sub_ps( _mm_set1_ps( 3.141592654f ), r ), r );
+	return _mm_or_ps( _mm_andnot_ps( signMask, r ), _mm_and_ps( signMask, y ) );
+}
+
+inline __m128 fastAsin( const __m128 x )
+{
+	const __m128 signMask = _mm_set1_ps( -0.f );
+	const __m128 a = _mm_andnot_ps( signMask, x );
+	const __m128 reflected = _mm_cmpgt_ps( a, _mm_set1_ps( 0.5f ) );
+	const __m128 z = fastSelect( reflected, _mm_mul_ps( _mm_set1_ps( 0.5f ), _mm_sub_ps( _mm_set1_ps( 1.f ), a ) ), _mm_mul_ps( a, a ) );
+	const __m128 s = fastSelect( reflected, _mm_sqrt_ps( z ), a );
+	const __m128 p = _mm_add_ps( _mm_mul_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( 4.2163199048e-2f ), z ), _mm_set1_ps( 2.4181311049e-2f ) ), z ), _mm_set1_ps( 4.5470025998e-2f ) ), z ), _mm_set1_ps( 7.4953002686e-2f ) ), z ), _mm_set1_ps( 1.6666752422e-1f ) ), z ), s ), s );
+	const __m128 r = fastSelect( reflected, _mm_sub_ps( _mm_set1_ps( 1.570796327f ), _mm_mul_ps( _mm_set1_ps( 2.f ), p ) ), p );
+	return _mm_or_ps( _mm_andnot_ps( signMask, r ), _mm_and_ps( signMask, x ) );
+}
+
+#ifdef __AVX2__
+inline __m256 fastSelect( const __m256 mask, const __m256 a, const __m256 b ) { return _mm256_blendv_ps( b, a, mask ); }
+
+inline void fastSinCos( const __m256 x, __m256 &s, __m256 &c )
+{
+	const __m256i q = _mm256_cvtps_epi32( _mm256_mul_ps( x, _mm256_set1_ps( 0.636619772f ) ) );
+	const __m256 j = _mm256_cvtepi32_ps( q );
+	const __m256 r = _mm256_sub_ps( _mm256_sub_ps( _mm256_sub_ps( x, _mm256_mul_ps( j, _mm256_set1_ps( FASTMATH_PIO2_1 ) ) ), _mm256_mul_ps( j, _mm256_set1_ps( FASTMATH_PIO2_2 ) ) ), _mm256_mul_ps( j, _mm256_set1_ps( FASTMATH_PIO2_3 ) ) );
+	const __m256 r2 = _mm256_mul_ps( r, r );
+
+	const __m256 sr = _mm256_add_ps( r, _mm256_mul_ps( _mm256_mul_ps( r, r2 ), _mm256_add_ps( _mm256_set1_ps( -1.6666654611e-1f ), _mm256_mul_ps( r2, _mm256_add_ps( _mm256_set1_ps( 8.3321608736e-3f ), _mm256_mul_ps( r2, _mm256_set1_ps( -1.9515295891e-4f ) ) ) ) ) ) );
+	const __m256 cr = _mm256_add_ps( _mm256_sub_ps( _mm256_set1_ps( 1.f ), _mm256_mul_ps( _mm256_set1_ps( 0.5f ), r2 ) ),
+									 _mm256_mul_ps( _mm256_mul_ps( r2, r2 ), _mm256_add_ps( _mm256_set1_ps( 4.166664568298827e-2f ), _mm256_mul_ps( r2, _mm256_add_ps( _mm256_set1_ps( -1.388731625493765e-3f ), _mm256_mul_ps( r2, _mm256_set1_ps( 2.443315711809948e-5f ) ) ) ) ) ) );
+
+	const __m256 odd = _mm256_castsi256_ps( _mm256_cmpeq_epi32( _mm256_and_si256( q, _mm256_set1_epi32( 1 ) ), _mm256_set1_epi32( 1 ) ) );
+	const __m256 sinSign = _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_and_si256( q, _mm256_set1_epi32( 2 ) ), 30 ) );
+	const __m256 cosSign = _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_and_si256( _mm256_add_epi32( q, _mm256_set1_epi32( 1 ) ), _mm256_set1_epi32( 2 ) ), 30 ) );
+
+	s = _mm256_xor_ps( fastSelect( odd, cr, sr ), sinSign );
+	c = _mm256_xor_ps( fastSelect( odd, sr, cr ), cosSign );
+}
+
+inline __m256 fastAtan2( const __m256 y, const __m256 x )
+{
+	const __m256 signMask = _mm256_set1_ps( -0.f );
+	const __m256 ax = _mm256_andnot_ps( signMask, x ), ay = _mm256_andnot_ps( signMask, y );
+	const __m256 hi = _mm256_max_ps( ax, ay ), lo = _mm256_min_ps( ax, ay );
+	const __m256 t = _mm256_and_ps( _mm256_cmp_ps( hi, _mm256_setzero_ps(), _CMP_GT_OQ ), _mm256_div_ps( lo, hi ) );
+
+	const __m256 one = _mm256_set1_ps( 1.f );
+	const __m256 shifted = _mm256_cmp_ps( t, _mm256_set1_ps( 0.414213562f ), _CMP_GT_OQ );
+	const __m256 u = fastSelect( shifted, _mm256_div_ps( _mm256_sub_ps( t, one ), _mm256_add_ps( t, one ) ), t );
+	const __m256 u2 = _mm256_mul_ps( u, u );
+	const __m256 p = _mm256_add_ps( _mm256_mul_ps( _mm256_mul_ps( _mm256_sub_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_sub_ps( _mm256_mul_ps( _mm256_set1_ps( 8.05374449538e-2f ), u2 ), _mm256_set1_ps( 1.38776856032e-1f ) ), u2 ), _mm256_set1_ps( 1.99777106478e-1f ) ), u2 ), _mm256_set1_ps( 3.33329491539e-1f ) ), u2 ), u ), u );
+	__m256 r = _mm256_add_ps( _mm256_and_ps( shifted, _mm256_set1_ps( 0.785398163f ) ), p );
+
+	r = fastSelect( _mm256_cmp_ps( ay, ax, _CMP_GT_OQ ), _mm256_sub_ps( _mm256_set1_ps( 1.570796327f ), r ), r );
+	r = fastSelect( _mm256_castsi256_ps( _mm256_srai_epi32( _mm256_castps_si256( x ), 31 ) ), _mm256_sub_ps( _mm256_set1_ps( 3.141592654f ), r ), r );
+	return _mm256_or_ps( _mm256_andnot_ps( signMask, r ), _mm256_and_ps( signMask, y ) );
+}
+
+inline __m256 fastAsin( const __m256 x )
+{
+	const __m256 signMask = _mm256_set1_ps( -0.f );
+	const __m256 a = _mm256_andnot_ps( signMask, x );
+	const __m256 reflected = _mm256_cmp_ps( a, _mm256_set1_ps( 0.5f ), _CMP_GT_OQ );
+	const __m256 z = fastSelect( reflected, _mm256_mul_ps( _mm256_set1_ps( 0.5f ), _mm256_sub_ps( _mm256_set1_ps( 1.f ), a ) ), _mm256_mul_ps( a, a ) );
+	const __m256 s = fastSelect( reflected, _mm256_sqrt_ps( z ), a );
+	const __m256 p = _mm256_add_ps( _mm256_mul_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( 4.2163199048e-2f ), z ), _mm256_set1_ps( 2.4181311049e-2f ) ), z ), _mm256_set1_ps( 4.5470025998e-2f ) ), z ), _mm256_set1_ps( 7.4953002686e-2f ) ), z ), _mm256_set1_ps( 1.6666752422e-1f ) ), z ), s ), s );
+	const __m256 r = fastSelect( reflected, _mm256_sub_ps( _mm256_set1_ps( 1.570796327f ), _mm256_mul_ps( _mm256_set1_ps( 2.f ), p ) ), p );
+	return _mm256_or_ps( _mm256_andnot_ps( signMask, r ), _mm256_and_ps( signMask, x ) );
+}
+#endif
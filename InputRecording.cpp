@@ -0,0 +1,96 @@
+#include "precomp.h"
+
+static void writeVec( ostream &out, const vec3 &v )
+{
+	out << " " << v.x << " " << v.y << " " << v.z;
+}
+
+static void readVec( istream &in, vec3 &v )
+{
+	in >> v.x >> v.y >> v.z;
+}
+
+// seed <seed>
+// frame <deltaTime> <keys> <mouse move count> [<x> <y> ...] <origin> <forward> <up> <right> <aperture> <focalLength> <focusDistance>
+bool InputRecording::save( const char *filename ) const
+{
+	ofstream out( filename );
+	if ( !out )
+	{
+		return false;
+	}
+
+	out.precision( 9 );
+	out << "seed " << seed << endl;
+
+	for ( const InputFrame &f : frames )
+	{
+		out << "frame " << f.deltaTime << " " << f.keys << " " << f.mouseMoves.size();
+		for ( const pair<int, int> &m : f.mouseMoves )
+		{
+			out << " " << m.first << " " << m.second;
+		}
+
+		writeVec( out, f.camera.origin );
+		writeVec( out, f.camera.forward );
+		writeVec( out, f.camera.up );
+		writeVec( out, f.camera.right );
+		out << " " << f.camera.aperture << " " << f.camera.focalLength << " " << f.camera.focusDistance << endl;
+	}
+
+	return true;
+}
+
+bool InputRecording::load( const char *filename )
+{
+	ifstream in( filename );
+	string tag;
+
+	if ( !in || !( in >> tag >> seed ) || tag != "seed" )
+	{
+		return false;
+	}
+
+	frames.clear();
+	while ( in >> tag && tag == "frame" )
+	{
+		InputFrame f;
+		size_t moves = 0;
+		in >> f.deltaTime >> f.keys >> moves;
+
+		for ( size_t i = 0; i < moves; i++ )
+		{
+			pair<int, int> m;
+			in >> m.first >> m.second;
+			f.mouseMoves.push_back( m );
+		}
+
+		readVec( in, f.camera.origin );
+		readVec( in, f.camera.forward );
+		readVec( in, f.camera.up );
+		readVec( in, f.camera.right );
+		in >> f.camera.aperture >> f.camera.focalLength >> f.camera.focusDistance;
+
+		if ( !in )
+		{
+			return false;
+		}
+		frames.push_back( f );
+	}
+
+	return true;
+}
+
+float percentile( vector<float> frameTimes, float p )
+{
+	if ( frameTimes.empty() )
+	{
+		return 0.f;
+	}
+
+	size_t rank = (size_t)ceilf( p / 100.f * frameTimes.size() );
+	rank = min( max( rank, (size_t)1 ), frameTimes.size() );
+
+	nth_element( frameTimes.begin(), frameTimes.begin() + ( rank - 1 ), frameTimes.end() );
+	return frameTimes[rank - 1];
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Input of one Game::Tick, recorded so the same camera path can be rendered again
+struct InputFrame
+{
+	float deltaTime;
+	uint keys;						  // Bit per held key, see game.cpp
+	vector<pair<int, int>> mouseMoves; // MouseMove events handled since the previous frame
+	Camera camera;					  // After the input of the frame, to verify a replay
+};
+
+// Text file with the render seed and one line per frame
+class InputRecording
+{
+  public:
+	unsigned seed = 0;
+	vector<InputFrame> frames;
+
+	bool save( const char *filename ) const;
+	bool load( const char *filename );
+};
+
+// Frame time percentile ( 0 - 100 ) by nearest rank, 0 without frames
+float percentile( vector<float> frameTimes, float p );
@@ -1,39 +1,36 @@
 #pragma once
 
+// Counted under MEM_TEXTURES for as long as it lives
 struct Texture
 {
 	unsigned int width;
 	unsigned int height;
 	vec3 *values;
-};
 
-enum MaterialType
-{
-	LAMBERTIAN_MAT,
-	EMIT_MAT // for lights
-};
-
-struct Material
-{
-	MaterialType type;
-	vec3 albedo;
-	vec3 emission;
+	Texture( unsigned int width, unsigned int height ) : width( width ), height( height ), values( new vec3[width * height] )
+	{
+		memoryTracker.allocate( MEM_TEXTURES, bytes() );
+	}
+	~Texture()
+	{
+		delete[] values;
+		memoryTracker.release( MEM_TEXTURES, bytes() );
+	}
+	Texture( const Texture & ) = delete;
+	Texture &operator=( const Texture & ) = delete;
 
-	void loadDiffuse( char *filename )
+	static Texture *load( const char *filename )
 	{
 		// Load file
 		Surface image = Surface( filename );
 
 		// Prepare Texture
-		diffuse = new Texture();
-		diffuse->height = image.GetHeight();
-		diffuse->width = image.GetWidth();
+		Texture *texture = new Texture( image.GetWidth(), image.GetHeight() );
 
 		// Load values into Texture
 		Pixel *buffer = image.GetBuffer();
-		diffuse->values = new vec3[diffuse->width * diffuse->height];
 
-		for ( unsigned i = 0; i < diffuse->height * diffuse->width; i++ )
+		for ( unsigned i = 0; i < texture->height * texture->width; i++ )
 		{
 			Color converter;
 			vec3 albedo = vec3();
@@ -44,16 +41,38 @@ struct Material
 			albedo.y = (float)converter.c.g / 255.f;
 			albedo.z = (float)converter.c.b / 255.f;
 
-			diffuse->values[i] = albedo;
+			texture->values[i] = albedo;
 		}
 
-		hasDiffuseTexture = true;
+		return texture;
+	}
+
+	int64 bytes() const { return int64( sizeof( Texture ) + sizeof( vec3 ) * width * height ); }
+};
+
+enum MaterialType
+{
+	LAMBERTIAN_MAT,
+	EMIT_MAT // for lights
+};
+
+struct Material
+{
+	MaterialType type;
+	vec3 albedo;
+	vec3 emission;
+	int id = -1; // Index into the renderer's material table, assigned by the Renderer
+
+	// The texture is owned by the scene, see SceneManager::addTexture
+	void setDiffuse( const Texture *texture )
+	{
+		diffuse = texture;
 	}
 
 	// Use this to get the albedo at the hit coordinates
-	vec3 getDiffuse( float u, float v )
+	vec3 getDiffuse( float u, float v ) const
 	{
-		if ( hasDiffuseTexture )
+		if ( diffuse )
 		{
 			int x = int( u * diffuse->width ) % diffuse->width;
 			int y = int( v * diffuse->height ) % diffuse->height;
@@ -65,7 +84,25 @@ struct Material
 		}
 	}
 
+	bool hasDiffuse() const
+	{
+		return diffuse != nullptr;
+	}
+
+	const Texture *getTexture() const
+	{
+		return diffuse;
+	}
+
+	// Materials are shared by id when everything but the id itself matches
+	bool sameAs( const Material &other ) const
+	{
+		return type == other.type &&
+			   albedo.x == other.albedo.x && albedo.y == other.albedo.y && albedo.z == other.albedo.z &&
+			   emission.x == other.emission.x && emission.y == other.emission.y && emission.z == other.emission.z &&
+			   diffuse == other.diffuse;
+	}
+
   private:
-	bool hasDiffuseTexture = false;
-	Texture *diffuse;
+	const Texture *diffuse = nullptr; // Plain pointer, so Hit stays trivially copyable
 };
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "precomp.h"
+
+MemoryTracker memoryTracker;
+
+void MemoryTracker::allocate( MemoryCategory category, int64 bytes )
+{
+	const int64 now = currentBytes[category] += bytes;
+
+	int64 peak = peakBytes[category];
+	while ( now > peak && !peakBytes[category].compare_exchange_weak( peak, now ) )
+	{
+	}
+}
+
+int64 MemoryTracker::total() const
+{
+	int64 sum = 0;
+	for ( int c = 0; c < MEM_CATEGORY_COUNT; c++ )
+	{
+		sum += currentBytes[c];
+	}
+	return sum;
+}
+
+void MemoryTracker::resetPeaks()
+{
+	for ( int c = 0; c < MEM_CATEGORY_COUNT; c++ )
+	{
+		peakBytes[c] = currentBytes[c].load();
+	}
+}
+
+const char *MemoryTracker::categoryName( MemoryCategory category )
+{
+	switch ( category )
+	{
+	case MEM_PRIMITIVES:
+		return "primitives";
+	case MEM_MATERIALS:
+		return "materials";
+	case MEM_TEXTURES:
+		return "textures";
+	case MEM_BVH:
+		return "bvh";
+	case MEM_SCENE:
+		return "scene";
+	case MEM_FRAMEBUFFERS:
+		return "framebuffers";
+	case MEM_OBJ_LOADING:
+		return "obj_loading";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+enum MemoryCategory
+{
+	MEM_PRIMITIVES,	  // Sphere and Triangle objects, without their material
+	MEM_MATERIALS,	  // Materials held by primitives and by scene snapshots
+	MEM_TEXTURES,	  // Texture values expanded to vec3
+	MEM_BVH,		  // BVH nodes and their primitive lists
+	MEM_SCENE,		  // Scene snapshots: primitive lists, lights and change history
+	MEM_FRAMEBUFFERS, // Accumulation, sample counts, signatures, output, primary hit cache and G-buffer
+	MEM_OBJ_LOADING,  // tinyobj intermediates, only while a file is loaded
+	MEM_CATEGORY_COUNT
+};
+
+// Current and peak bytes per category, explicitly accounted where the memory is allocated and freed
+// Only ever used as a global: it relies on zero initialization, so objects constructed during static
+// initialization of other files are counted too
+class MemoryTracker
+{
+  public:
+	void allocate( MemoryCategory category, int64 bytes );
+	void release( MemoryCategory category, int64 bytes ) { allocate( category, -bytes ); }
+
+	int64 current( MemoryCategory category ) const { return currentBytes[category]; }
+	int64 peak( MemoryCategory category ) const { return peakBytes[category]; }
+	int64 total() const;
+
+	// Start measuring peaks from the current usage, e.g. per benchmark scene
+	void resetPeaks();
+
+	static const char *categoryName( MemoryCategory category );
+
+  private:
+	atomic<int64> currentBytes[MEM_CATEGORY_COUNT];
+	atomic<int64> peakBytes[MEM_CATEGORY_COUNT];
+};
+
+extern MemoryTracker memoryTracker;
+
+// Base class that counts every instance of T, copies included, for as long as it lives
+// Not for types that are copied in hot loops, every instance costs an atomic add
+// excluded: bytes of members that are counted on their own
+template <typename T, MemoryCategory category, size_t excluded = 0>
+struct MemoryTracked
+{
+	MemoryTracked() { memoryTracker.allocate( category, int64( sizeof( T ) - excluded ) ); }
+	MemoryTracked( const MemoryTracked & ) : MemoryTracked() {}
+	MemoryTracked &operator=( const MemoryTracked & ) { return *this; }
+	~MemoryTracked() { memoryTracker.release( category, int64( sizeof( T ) - excluded ) ); }
+};
@@ -28,6 +28,16 @@ vector<Primitive *> loadOBJ( const char *filename, const Material &defaultMat )
 		return vector<Primitive *>();
 	}
 
+	// Everything tinyobj loaded, released again once the triangles are built
+	size_t intermediateBytes = ( attributes.vertices.capacity() + attributes.normals.capacity() + attributes.texcoords.capacity() + attributes.colors.capacity() ) * sizeof( tinyobj::real_t ) +
+							   materials.capacity() * sizeof( tinyobj::material_t ) + shapes.capacity() * sizeof( tinyobj::shape_t );
+	for ( const tinyobj::shape_t &shape : shapes )
+	{
+		intermediateBytes += shape.mesh.indices.capacity() * sizeof( tinyobj::index_t ) + shape.mesh.num_face_vertices.capacity() +
+							 ( shape.mesh.material_ids.capacity() + shape.mesh.smoothing_group_ids.capacity() ) * sizeof( int );
+	}
+	memoryTracker.allocate( MEM_OBJ_LOADING, intermediateBytes );
+
 	// Loop over shapes
 	for ( size_t s = 0; s < shapes.size(); s++ )
 	{
@@ -63,8 +73,11 @@ vector<Primitive *> loadOBJ( const char *filename, const Material &defaultMat )
 			shapes[s].mesh.material_ids[f];
 
 			result.push_back( new Triangle( defaultMat, verts, uv ) );
+			delete[] verts;
+			delete[] uv;
 		}
 	}
 
+	memoryTracker.release( MEM_OBJ_LOADING, intermediateBytes );
 	return result;
 }
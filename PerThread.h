@@ -0,0 +1,103 @@
+#pragma once
+
+// Index of the calling render thread, 0 outside of parallel regions
+inline int threadIndex()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num() % MAXTHREADS;
+#else
+	return 0;
+#endif
+}
+
+// One T per render thread, written without locks and summed while no render thread runs
+// A T is created the first time its thread uses it, on cache lines of its own to avoid false sharing
+// between threads. The blocks are allocated apart, new does not honour over-alignment before C++17
+template <typename T>
+class PerThread
+{
+  public:
+	PerThread()
+	{
+		for ( atomic<T *> &slot : slots )
+		{
+			slot.store( nullptr );
+		}
+	}
+	~PerThread()
+	{
+		for ( atomic<T *> &slot : slots )
+		{
+			if ( T *t = slot.load() )
+			{
+				t->~T();
+				FREE64( t );
+			}
+		}
+	}
+	PerThread( const PerThread & ) = delete;
+	PerThread &operator=( const PerThread & ) = delete;
+
+	T &local()
+	{
+		const int index = threadIndex();
+		T *t = slots[index].load( memory_order_acquire );
+		return t ? *t : create( index );
+	}
+
+	// Calls f( index, t ) for the T of every thread that has one
+	// Like gather(), only call this while no render threads are running
+	template <typename F>
+	void forEach( F f )
+	{
+		for ( int i = 0; i < MAXTHREADS; i++ )
+		{
+			if ( T *t = slots[i].load( memory_order_acquire ) )
+			{
+				f( i, *t );
+			}
+		}
+	}
+	template <typename F>
+	void forEach( F f ) const
+	{
+		for ( int i = 0; i < MAXTHREADS; i++ )
+		{
+			if ( const T *t = slots[i].load( memory_order_acquire ) )
+			{
+				f( i, *t );
+			}
+		}
+	}
+
+	// Sum the values of every thread into totals and clear them
+	template <size_t N>
+	void gather( uint64 ( T::*values )[N], uint64 totals[N] )
+	{
+		memset( totals, 0, sizeof( uint64 ) * N );
+		forEach( [&]( int, T &t ) {
+			for ( size_t i = 0; i < N; i++ )
+			{
+				totals[i] += ( t.*values )[i];
+				( t.*values )[i] = 0;
+			}
+		} );
+	}
+
+  private:
+	atomic<T *> slots[MAXTHREADS];
+
+	// Threads that share an index, such as threads outside of OpenMP, may race to create it
+	T &create( int index )
+	{
+		T *t = new ( MALLOC64( ( sizeof( T ) + 63 ) / 64 * 64 ) ) T();
+		T *expected = nullptr;
+		if ( !slots[index].compare_exchange_strong( expected, t, memory_order_acq_rel ) )
+		{
+			t->~T();
+			FREE64( t );
+			return *expected;
+		}
+		return *t;
+	}
+};
@@ -0,0 +1,180 @@
+#include "precomp.h"
+
+PerfCounters perfCounters;
+
+PerfCounters::PerfCounters() : counting( false ), available( true )
+{
+	memset( totals, 0, sizeof( totals ) );
+}
+
+void PerfCounters::start()
+{
+	phases.forEach( []( int, ThreadPhases &thread ) { memset( thread.values, 0, sizeof( thread.values ) ); } );
+	memset( totals, 0, sizeof( totals ) );
+	counting = true;
+}
+
+void PerfCounters::stop()
+{
+	counting = false;
+}
+
+const char *PerfCounters::phaseName( PerfPhase phase )
+{
+	switch ( phase )
+	{
+	case PERF_BUILD:
+		return "build";
+	case PERF_TRAVERSE:
+		return "traverse";
+	case PERF_SHADE:
+		return "shade";
+	case PERF_RESOLVE:
+		return "resolve";
+	default:
+		return "unknown";
+	}
+}
+
+// The events of a thread count that thread, whichever thread index it has, so they are kept per thread
+// rather than in PerThread. Threads outside of OpenMP all have index 0
+struct ThreadCounters
+{
+	bool opened = false;
+	int fds[PERF_EVENT_COUNT]; // -1 for events that could not be opened, the first open one leads the group
+
+	ThreadCounters()
+	{
+		for ( int e = 0; e < PERF_EVENT_COUNT; e++ )
+		{
+			fds[e] = -1;
+		}
+	}
+	~ThreadCounters() { close(); }
+
+	bool open(); // False when none of the events could be opened
+	void close();
+};
+
+static thread_local ThreadCounters threadCounters;
+
+#ifdef __linux__
+
+// Counts the calling thread on any CPU, user space only so a paranoid level of 2 still allows it
+bool ThreadCounters::open()
+{
+	static const uint64 configs[PERF_EVENT_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+	opened = true;
+	int leader = -1;
+
+	for ( int e = 0; e < PERF_EVENT_COUNT; e++ )
+	{
+		perf_event_attr attr;
+		memset( &attr, 0, sizeof( attr ) );
+		attr.size = sizeof( attr );
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[e];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		fds[e] = (int)syscall( __NR_perf_event_open, &attr, 0, -1, leader, 0 );
+		if ( leader == -1 )
+		{
+			leader = fds[e];
+		}
+	}
+
+	return leader != -1;
+}
+
+void ThreadCounters::close()
+{
+	for ( int e = 0; e < PERF_EVENT_COUNT; e++ )
+	{
+		if ( fds[e] != -1 )
+		{
+			::close( fds[e] );
+			fds[e] = -1;
+		}
+	}
+	opened = false;
+}
+
+// One read of the group leader returns all counters of the thread, in the order they were opened
+void PerfCounters::read( uint64 values[PERF_EVENT_COUNT] )
+{
+	ThreadCounters &thread = threadCounters;
+	if ( !thread.opened && !thread.open() )
+	{
+		available = false;
+	}
+
+	memset( values, 0, sizeof( uint64 ) * PERF_EVENT_COUNT );
+
+	int leader = -1;
+	for ( int e = 0; e < PERF_EVENT_COUNT && leader == -1; e++ )
+	{
+		leader = thread.fds[e];
+	}
+
+	uint64 group[1 + PERF_EVENT_COUNT];
+	if ( leader == -1 || ::read( leader, group, sizeof( group ) ) <= 0 )
+	{
+		return;
+	}
+
+	for ( int e = 0, i = 1; e < PERF_EVENT_COUNT && i <= (int)group[0]; e++ )
+	{
+		if ( thread.fds[e] != -1 )
+		{
+			values[e] = group[i++];
+		}
+	}
+}
+
+#else
+
+bool ThreadCounters::open()
+{
+	opened = true;
+	return false;
+}
+
+void ThreadCounters::close()
+{
+	opened = false;
+}
+
+void PerfCounters::read( uint64 values[PERF_EVENT_COUNT] )
+{
+	ThreadCounters &thread = threadCounters;
+	if ( !thread.opened && !thread.open() )
+	{
+		available = false;
+	}
+
+	memset( values, 0, sizeof( uint64 ) * PERF_EVENT_COUNT );
+}
+
+#endif
+
+void PerfCounters::add( PerfPhase phase, const uint64 start[PERF_EVENT_COUNT], const uint64 end[PERF_EVENT_COUNT] )
+{
+	uint64 *values = phases.local().values + phase * PERF_EVENT_COUNT;
+	for ( int e = 0; e < PERF_EVENT_COUNT; e++ )
+	{
+		values[e] += end[e] - start[e];
+	}
+}
+
+void PerfCounters::gather()
+{
+	uint64 sums[PERF_PHASE_COUNT * PERF_EVENT_COUNT];
+	phases.gather( &ThreadPhases::values, sums );
+	for ( int p = 0; p < PERF_PHASE_COUNT; p++ )
+	{
+		memcpy( totals[p].values, sums + p * PERF_EVENT_COUNT, sizeof( totals[p].values ) );
+	}
+}
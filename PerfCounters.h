@@ -0,0 +1,104 @@
+#pragma once
+
+// Render phases hardware counters are attributed to
+// The renderer interleaves traversal with shading per pixel, so its tiles count as PERF_SHADE and
+// pure traversal is only measured where it runs on its own: batched scene queries and the benchmarks
+enum PerfPhase
+{
+	PERF_BUILD,	// BVH construction
+	PERF_TRAVERSE, // BVH traversal without shading
+	PERF_SHADE,	// Rendering tiles
+	PERF_RESOLVE,  // Turning the accumulated radiance into the output image
+	PERF_PHASE_COUNT
+};
+
+enum PerfEvent
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENT_COUNT
+};
+
+struct PerfSample
+{
+	uint64 values[PERF_EVENT_COUNT];
+
+	// Instructions per cycle
+	float ipc() const { return values[PERF_CYCLES] ? float( values[PERF_INSTRUCTIONS] ) / float( values[PERF_CYCLES] ) : 0.f; }
+
+	// Misses per thousand instructions
+	float mpki( PerfEvent event ) const { return values[PERF_INSTRUCTIONS] ? values[event] * 1000.f / float( values[PERF_INSTRUCTIONS] ) : 0.f; }
+};
+
+// Hardware counters of every thread, read through perf_event_open on Linux
+// Counters of a thread are opened the first time it enters a phase after start(), and closed when it exits.
+// Without permission
+// (see /proc/sys/kernel/perf_event_paranoid), without a PMU (many VMs) or on other platforms,
+// isAvailable() turns false and all values stay 0.
+class PerfCounters
+{
+  public:
+	PerfCounters();
+
+	// Clears the totals and starts counting
+	void start();
+	void stop();
+	bool isCounting() const { return counting; }
+	bool isAvailable() const { return available; }
+
+	// Current values of the counters of the calling thread
+	void read( uint64 values[PERF_EVENT_COUNT] );
+	void add( PerfPhase phase, const uint64 start[PERF_EVENT_COUNT], const uint64 end[PERF_EVENT_COUNT] );
+
+	// Sum the phases of all threads into the totals of the last frame and start again
+	// Only call this while no render threads are running
+	void gather();
+	const PerfSample &get( PerfPhase phase ) const { return totals[phase]; }
+
+	static const char *phaseName( PerfPhase phase );
+
+  private:
+	struct ThreadPhases
+	{
+		uint64 values[PERF_PHASE_COUNT * PERF_EVENT_COUNT]; // By phase, then event
+	};
+
+	bool counting;
+	bool available;
+	PerThread<ThreadPhases> phases;
+	PerfSample totals[PERF_PHASE_COUNT];
+};
+
+extern PerfCounters perfCounters;
+
+// Adds the counter values during the lifetime of the scope to a phase, nested scopes count for both
+class PerfScope
+{
+  public:
+	PerfScope( PerfPhase phase ) : phase( phase ), active( perfCounters.isCounting() )
+	{
+		if ( active ) perfCounters.read( start );
+	}
+	~PerfScope()
+	{
+		if ( active )
+		{
+			uint64 end[PERF_EVENT_COUNT];
+			perfCounters.read( end );
+			perfCounters.add( phase, start, end );
+		}
+	}
+
+  private:
+	PerfPhase phase;
+	bool active;
+	uint64 start[PERF_EVENT_COUNT];
+};
+
+#ifdef PERF_COUNTERS
+#define PERF_SCOPE( phase ) PerfScope PROFILE_JOIN( perfScope, __LINE__ )( phase )
+#else
+#define PERF_SCOPE( phase )
+#endif
@@ -1,9 +1,11 @@
 #pragma once
 
-struct Primitive
+// Every primitive holds a copy of its material
+struct Primitive : public MemoryTracked<Material, MEM_MATERIALS>
 {
 	vec3 origin;
 	Material mat;
+	int id = -1; // Index into the renderer's primitive list, assigned by the Renderer
 
 	Primitive()
 	{
@@ -12,12 +14,32 @@ struct Primitive
 	}
 
 	Primitive( vec3 origin, Material mat ) : origin( origin ), mat( mat ) {}
+	virtual ~Primitive() {}
 
 	virtual Hit hit( const Ray &ray ) const = 0;
 	virtual aabb volume() const = 0;
+
+	// Scene edits modify a copy, published primitives are shared by the render threads
+	virtual Primitive *clone() const = 0;
+	virtual void transform( const mat4 &m ) = 0;
+
+	// Direction from p towards a random point of the primitive, for sampling it as a light. u1 and u2 are uniform
+	// in [0, 1). Returns the probability density of the direction per steradian, 0 when the sample is unusable.
+	// distance is that of the sampled point
+	virtual float sampleDirection( const vec3 &p, float u1, float u2, vec3 &direction, float &distance ) const = 0;
 };
 
-struct Sphere : public Primitive
+// Two unit vectors that make an orthonormal basis with unit vector n (Duff et al. 2017)
+inline void orthonormalBasis( const vec3 &n, vec3 &t, vec3 &b )
+{
+	const float sign = copysignf( 1.f, n.z );
+	const float a = -1.f / ( sign + n.z );
+	const float c = n.x * n.y * a;
+	t = vec3( 1.f + sign * n.x * n.x * a, sign * c, -sign * n.x );
+	b = vec3( c, sign + n.y * n.y * a, -n.y );
+}
+
+struct Sphere : public Primitive, MemoryTracked<Sphere, MEM_PRIMITIVES, sizeof( Material )>
 {
 	float radius;
 	float r2;
@@ -53,6 +75,7 @@ struct Sphere : public Primitive
 			h.t = t;
 			h.coordinates = r( t );
 			h.mat = mat;
+			h.primitiveId = id;
 
 			vec3 normal = h.coordinates - origin;
 			normal.normalize();
@@ -70,8 +93,8 @@ struct Sphere : public Primitive
 			}
 
 			// Calculate UV coordinates for the texture
-			h.u = 0.5f + atan2( normal.y, normal.x ) / 2 * PI;
-			h.v = 0.5f - asin( normal.y ) / PI;
+			h.u = 0.5f + fastAtan2( normal.y, normal.x ) / 2 * PI;
+			h.v = 0.5f - fastAsin( normal.y ) / PI;
 
 			return h;
 		}
@@ -88,14 +111,15 @@ struct Sphere : public Primitive
 				h.coordinates = r( t1 );
 
 				h.mat = mat;
+				h.primitiveId = id;
 
 				vec3 normal = h.coordinates - origin;
 				normal.normalize();
 				h.normal = normal;
 
 				// Calculate UV coordinates for the texture
-				h.u = 0.5f + atan2( normal.y, normal.x ) / 2 * PI;
-				h.v = 0.5f - asin( normal.y ) / PI;
+				h.u = 0.5f + fastAtan2( normal.y, normal.x ) / 2 * PI;
+				h.v = 0.5f - fastAsin( normal.y ) / PI;
 
 				return h;
 			}
@@ -107,14 +131,15 @@ struct Sphere : public Primitive
 
 				h.coordinates = r( t2 );
 				h.mat = mat;
+				h.primitiveId = id;
 
 				vec3 normal = h.coordinates - origin;
 				normal.normalize();
 				h.normal = normal;
 
 				// Calculate UV coordinates for the texture
-				h.u = 0.5f + atan2( normal.y, normal.x ) / 2 * PI;
-				h.v = 0.5f - asin( normal.y ) / PI;
+				h.u = 0.5f + fastAtan2( normal.y, normal.x ) / 2 * PI;
+				h.v = 0.5f - fastAsin( normal.y ) / PI;
 
 				return h;
 			}
@@ -136,6 +161,58 @@ struct Sphere : public Primitive
 		aabb bounds = aabb( origin - vec3( radius + EPSILON, radius + EPSILON, radius + EPSILON ), origin + vec3( radius + EPSILON, radius + EPSILON, radius + EPSILON ) );
 		return bounds;
 	}
+
+	Primitive *clone() const override
+	{
+		return new Sphere( *this );
+	}
+
+	// Assumes uniform scaling
+	void transform( const mat4 &m ) override
+	{
+		origin = ( m * vec4( origin, 1.f ) ).xyz;
+		radius *= ( m * vec4( 1.f, 0.f, 0.f, 0.f ) ).xyz.length();
+		r2 = radius * radius;
+	}
+
+	// Uniform over the cone of directions in which p sees the sphere, over all directions when p is inside
+	float sampleDirection( const vec3 &p, float u1, float u2, vec3 &direction, float &distance ) const override
+	{
+		const vec3 toCentre = origin - p;
+		const float d2 = toCentre.sqrLentgh();
+		float sinPhi, cosPhi;
+		fastSinCos( 2 * PI * u2, sinPhi, cosPhi );
+
+		if ( d2 <= r2 )
+		{
+			const float cosTheta = 1.f - 2.f * u1;
+			const float sinTheta = sqrtf( max( 0.f, 1.f - cosTheta * cosTheta ) );
+			direction = vec3( sinTheta * cosPhi, sinTheta * sinPhi, cosTheta );
+
+			// Where the ray leaves the sphere
+			const float b = direction.dot( toCentre );
+			distance = b + sqrtf( max( 0.f, b * b - d2 + r2 ) );
+			return 1.f / ( 4 * PI );
+		}
+
+		const float d = sqrtf( d2 );
+		const vec3 w = toCentre * ( 1.f / d );
+		vec3 t, b;
+		orthonormalBasis( w, t, b );
+
+		// 1 - cos written without the cancellation of small or distant spheres
+		const float sin2Max = r2 / d2;
+		const float coneHeight = sin2Max / ( 1.f + sqrtf( 1.f - sin2Max ) );
+		const float oneMinusCos = u1 * coneHeight;
+		const float cosTheta = 1.f - oneMinusCos;
+		const float sin2Theta = oneMinusCos * ( 2.f - oneMinusCos );
+		const float sinTheta = sqrtf( sin2Theta );
+		direction = ( t * cosPhi + b * sinPhi ) * sinTheta + w * cosTheta;
+
+		// The near side of the sphere
+		distance = d * cosTheta - sqrtf( max( 0.f, r2 - d2 * sin2Theta ) );
+		return 1.f / ( 2 * PI * coneHeight );
+	}
 };
 
 // Deprecated since AABB cannot be easily determined for an infinite plane
@@ -198,7 +275,7 @@ struct Sphere : public Primitive
 	}
 };*/
 
-struct Triangle : public Primitive
+struct Triangle : public Primitive, MemoryTracked<Triangle, MEM_PRIMITIVES, sizeof( Material )>
 {
 	vec3 v0, v1, v2;
 	vec2 uv0, uv1, uv2;
@@ -225,9 +302,6 @@ struct Triangle : public Primitive
 		const vec3 &edge_1 = v1 - v0;
 		const vec3 &edge_2 = v2 - v0;
 
-		// Normal
-		const vec3 &n = edge_1.cross( edge_2 ).normalized();
-
 		const vec3 &q = ray.direction.cross( edge_2 );
 		const float a = edge_1.dot( q );
 
@@ -255,39 +329,91 @@ struct Triangle : public Primitive
 		const float t = edge_2.dot( r );
 		if ( t >= 0.f )
 		{
-			// From what direction do we hit the triangle? Inside or Outside?
-			if ( n.dot( ray.direction ) >= 0.f )
-			{
-				h.hitType = -1;
-			}
-			else
-			{
-				h.hitType = 1;
-			}
+			return hitAt( ray, t, b0, b1 );
+		}
+		else
+		{
+			return h;
+		}
+	}
 
-			h.coordinates = ray( t );
-			h.t = t;
-			h.mat = mat;
-			h.normal = n;
+	// Fills in the hit for a known ray parameter and barycentric coordinates
+	// Shared with the rasterizer, so both produce the same hits
+	Hit hitAt( const Ray &ray, float t, float b0, float b1 ) const
+	{
+		Hit h = Hit();
+		const float b2 = 1.f - b0 - b1;
 
-			// Calculate UV
-			h.u = b0 * uv0.x + b1 * uv1.x + b2 * uv2.x;
-			h.v = b0 * uv0.y + b1 * uv1.y + b2 * uv2.y;
-			return h;
+		// Normal
+		const vec3 &n = ( v1 - v0 ).cross( v2 - v0 ).normalized();
+
+		// From what direction do we hit the triangle? Inside or Outside?
+		if ( n.dot( ray.direction ) >= 0.f )
+		{
+			h.hitType = -1;
 		}
 		else
 		{
-			return h;
+			h.hitType = 1;
 		}
+
+		h.coordinates = ray( t );
+		h.t = t;
+		h.mat = mat;
+		h.primitiveId = id;
+		h.normal = n;
+		h.barycentrics = vec2( b0, b1 );
+
+		// Calculate UV
+		h.u = b0 * uv0.x + b1 * uv1.x + b2 * uv2.x;
+		h.v = b0 * uv0.y + b1 * uv1.y + b2 * uv2.y;
+		return h;
 	}
 
 	aabb volume() const override
 	{
 		aabb bounds = aabb();
 		bounds.Reset();
-		bounds.Grow( vec3( v0.x + EPSILON, v0.y + EPSILON, v0.z + EPSILON ) );
-		bounds.Grow( vec3( v1.x + EPSILON, v1.y + EPSILON, v1.z + EPSILON ) );
-		bounds.Grow( vec3( v2.x + EPSILON, v2.y + EPSILON, v2.z + EPSILON ) );
+		bounds.Grow( v0 );
+		bounds.Grow( v1 );
+		bounds.Grow( v2 );
+
+		// Padded on both sides, so axis aligned triangles do not get flat bounds
+		bounds.bmin3 -= vec3( EPSILON, EPSILON, EPSILON );
+		bounds.bmax3 += vec3( EPSILON, EPSILON, EPSILON );
 		return bounds;
 	}
-};
\ No newline at end of file
+
+	Primitive *clone() const override
+	{
+		return new Triangle( *this );
+	}
+
+	void transform( const mat4 &m ) override
+	{
+		v0 = ( m * vec4( v0, 1.f ) ).xyz;
+		v1 = ( m * vec4( v1, 1.f ) ).xyz;
+		v2 = ( m * vec4( v2, 1.f ) ).xyz;
+
+		origin = vec3( ( v0.x + v1.x + v2.x ) / 3, ( v0.y + v1.y + v2.y ) / 3, ( v0.z + v1.z + v2.z ) / 3 );
+	}
+
+	// Uniform over the area of the triangle, converted to a density per steradian. Emits from both sides
+	float sampleDirection( const vec3 &p, float u1, float u2, vec3 &direction, float &distance ) const override
+	{
+		const float s = sqrtf( u1 );
+		direction = v0 * ( 1.f - s ) + v1 * ( s * ( 1.f - u2 ) ) + v2 * ( s * u2 ) - p;
+		const float d2 = direction.sqrLentgh();
+		distance = sqrtf( d2 );
+		direction *= 1.f / distance;
+
+		// Area times the cosine at the light, half the length of the cross product
+		const float projectedArea = 0.5f * abs( ( v1 - v0 ).cross( v2 - v0 ).dot( direction ) );
+		if ( !( projectedArea > 0.f ) )
+		{
+			return 0.f;
+		}
+
+		return d2 / projectedArea;
+	}
+};
@@ -0,0 +1,116 @@
+#include "precomp.h"
+
+Profiler profiler;
+
+Profiler::Profiler() : epoch( chrono::steady_clock::now() ), capturing( false ), startTime( 0 ), startTicks( 0 ), tickOverhead( 0 )
+{
+}
+
+void Profiler::start()
+{
+	threads.forEach( []( int, ThreadEvents &thread ) {
+		thread.count = 0;
+		memset( thread.counters, 0, sizeof( thread.counters ) );
+		memset( thread.calls, 0, sizeof( thread.calls ) );
+	} );
+
+	samples.clear();
+
+	tickOverhead = UINT64_MAX;
+	for ( int i = 0; i < 1000; i++ )
+	{
+		uint64 t = ticks();
+		tickOverhead = min( tickOverhead, ticks() - t );
+	}
+
+	startTime = now();
+	startTicks = ticks();
+	capturing = true;
+}
+
+void Profiler::stop()
+{
+	capturing = false;
+}
+
+int64 Profiler::now() const
+{
+	return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - epoch ).count();
+}
+
+void Profiler::sample()
+{
+	if ( !capturing )
+	{
+		return;
+	}
+
+	CounterSample s;
+	s.time = now();
+	const double msPerTick = ( s.time - startTime ) / 1e6 / max( double( ticks() - startTicks ), 1.0 );
+
+	uint64 totals[PROFILE_COUNTER_COUNT];
+	threads.gather( &ThreadEvents::counters, totals );
+	for ( int c = 0; c < PROFILE_COUNTER_COUNT; c++ )
+	{
+		s.counters[c] = totals[c] * msPerTick;
+	}
+
+	samples.push_back( s );
+}
+
+// Timestamps in the trace format are microseconds
+bool Profiler::exportTrace( const char *filename ) const
+{
+	static const char *counterNames[PROFILE_COUNTER_COUNT] = {"primary", "shading"};
+
+	ofstream out( filename );
+	if ( !out )
+	{
+		return false;
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"renderer\"}}";
+
+	threads.forEach( [&out]( int t, const ThreadEvents &thread ) {
+		if ( thread.count == 0 )
+		{
+			return;
+		}
+
+		out << "," << endl
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"thread " << t << "\"}}";
+
+		// Oldest first, the ring only holds the last PROFILEEVENTS
+		const uint64 first = thread.count > PROFILEEVENTS ? thread.count - PROFILEEVENTS : 0;
+		for ( uint64 i = first; i < thread.count; i++ )
+		{
+			const ProfileEvent &e = thread.events[i % PROFILEEVENTS];
+			out << "," << endl
+				<< "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+				<< ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << e.duration / 1000.0;
+			if ( e.x >= 0 )
+			{
+				out << ",\"args\":{\"x\":" << e.x << ",\"y\":" << e.y << "}";
+			}
+			out << "}";
+		}
+	} );
+
+	// Milliseconds of work per frame, summed over the threads
+	for ( const CounterSample &s : samples )
+	{
+		out << "," << endl
+			<< "{\"name\":\"frame work (ms)\",\"ph\":\"C\",\"pid\":1,\"ts\":" << s.time / 1000.0 << ",\"args\":{";
+		for ( int c = 0; c < PROFILE_COUNTER_COUNT; c++ )
+		{
+			out << ( c > 0 ? "," : "" ) << "\"" << counterNames[c] << "\":" << s.counters[c];
+		}
+		out << "}}";
+	}
+
+	out << endl
+		<< "]}" << endl;
+	return true;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// Time summed over all threads per frame, exported as counter tracks
+enum ProfileCounter
+{
+	PROFILE_PRIMARY, // Primary visibility, traced or rasterized
+	PROFILE_SHADING, // Everything after the primary hit: secondary rays, shadow rays and materials
+	PROFILE_COUNTER_COUNT
+};
+
+// A finished scope on one thread, a "complete" event in the Chrome trace format
+struct ProfileEvent
+{
+	const char *name; // Must outlive the profiler, in practice a string literal
+	int64 start;	  // Nanoseconds since the profiler was created
+	int64 duration;
+	int x, y; // Tile coordinates, -1 outside of tiles
+};
+
+// Scoped timers write into a ring buffer per thread without locks, the oldest events get overwritten
+// Nothing is recorded until start(), until then a scope costs a single branch. A thread allocates its buffer
+// when it records its first event
+class Profiler
+{
+  public:
+	Profiler();
+
+	// Clears the buffers and starts recording
+	void start();
+	void stop();
+	bool isCapturing() const { return capturing; }
+
+	int64 now() const;
+
+	void record( const char *name, int64 start, int x = -1, int y = -1 )
+	{
+		ThreadEvents &thread = threads.local();
+		if ( thread.events.empty() )
+		{
+			thread.events.resize( PROFILEEVENTS );
+		}
+		ProfileEvent &e = thread.events[thread.count++ % PROFILEEVENTS];
+		e.name = name;
+		e.start = start;
+		e.duration = now() - start;
+		e.x = x;
+		e.y = y;
+	}
+
+	// Cheaper than now(), in CPU timestamp counter ticks, for the accumulated counters
+	static uint64 ticks() { return __rdtsc(); }
+
+	// Whether to time the next scope of a counter, to keep timer overhead small in inner loops
+	bool timeNext( ProfileCounter counter )
+	{
+		return threads.local().calls[counter]++ % PROFILESTRIDE == 0;
+	}
+
+	void accumulate( ProfileCounter counter, uint64 duration )
+	{
+		// Without the cost of reading the counter itself, which is significant at this scale
+		duration = duration > tickOverhead ? duration - tickOverhead : 0;
+		threads.local().counters[counter] += duration * PROFILESTRIDE;
+	}
+
+	// Sum the counters of all threads into one sample at the current time
+	// Like exportTrace(), only call this while no render threads are running
+	void sample();
+
+	// Writes a JSON file for chrome://tracing or ui.perfetto.dev
+	bool exportTrace( const char *filename ) const;
+
+  private:
+	struct CounterSample
+	{
+		int64 time;
+		double counters[PROFILE_COUNTER_COUNT]; // Milliseconds
+	};
+
+	struct ThreadEvents
+	{
+		vector<ProfileEvent> events; // PROFILEEVENTS, empty until the first event of the thread
+		uint64 count;
+		uint64 counters[PROFILE_COUNTER_COUNT]; // Ticks
+		uint64 calls[PROFILE_COUNTER_COUNT];
+	};
+
+	chrono::steady_clock::time_point epoch;
+	bool capturing;
+
+	// Clock and ticks at the start of the capture, to convert ticks into time
+	int64 startTime;
+	uint64 startTicks;
+	uint64 tickOverhead;
+	PerThread<ThreadEvents> threads;
+	vector<CounterSample> samples;
+};
+
+extern Profiler profiler;
+
+// Records the lifetime of the scope as an event
+class ProfileScope
+{
+  public:
+	ProfileScope( const char *name, int x = -1, int y = -1 ) : name( name ), x( x ), y( y ), start( profiler.isCapturing() ? profiler.now() : -1 ) {}
+	~ProfileScope()
+	{
+		if ( start >= 0 ) profiler.record( name, start, x, y );
+	}
+
+  private:
+	const char *name;
+	int x, y;
+	int64 start;
+};
+
+// Adds the lifetime of the scope to a counter, for work too fine grained for events of its own
+// Only one in PROFILESTRIDE scopes is timed, so the counters are estimates
+class ProfileAccumulator
+{
+  public:
+	ProfileAccumulator( ProfileCounter counter ) : counter( counter ), start( profiler.isCapturing() && profiler.timeNext( counter ) ? Profiler::ticks() : 0 ) {}
+	~ProfileAccumulator()
+	{
+		if ( start ) profiler.accumulate( counter, Profiler::ticks() - start );
+	}
+
+  private:
+	ProfileCounter counter;
+	uint64 start;
+};
+
+#define PROFILE_JOIN2( a, b ) a##b
+#define PROFILE_JOIN( a, b ) PROFILE_JOIN2( a, b )
+
+#ifdef PROFILING
+#define PROFILE_SCOPE( name ) ProfileScope PROFILE_JOIN( profileScope, __LINE__ )( name )
+#define PROFILE_TILE( name, x, y ) ProfileScope PROFILE_JOIN( profileScope, __LINE__ )( name, x, y )
+#define PROFILE_ACCUMULATE( counter ) ProfileAccumulator PROFILE_JOIN( profileAccumulator, __LINE__ )( counter )
+#define PROFILE_SAMPLE() profiler.sample()
+#else
+#define PROFILE_SCOPE( name )
+#define PROFILE_TILE( name, x, y )
+#define PROFILE_ACCUMULATE( counter )
+#define PROFILE_SAMPLE()
+#endif
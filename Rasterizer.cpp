@@ -0,0 +1,261 @@
+#include "precomp.h"
+
+Rasterizer::Rasterizer()
+{
+	supported = false;
+
+	gbuffer = new GBufferSample[SCRWIDTH * SCRHEIGHT];
+	memoryTracker.allocate( MEM_FRAMEBUFFERS, sizeof( GBufferSample ) * SCRWIDTH * SCRHEIGHT );
+
+	tilesX = ( SCRWIDTH + TILESIZE - 1 ) / TILESIZE;
+	tilesY = ( SCRHEIGHT + TILESIZE - 1 ) / TILESIZE;
+	tileTriangles.resize( tilesX * tilesY );
+}
+
+Rasterizer::~Rasterizer()
+{
+	delete[] gbuffer;
+	gbuffer = nullptr;
+	memoryTracker.release( MEM_FRAMEBUFFERS, sizeof( GBufferSample ) * SCRWIDTH * SCRHEIGHT );
+}
+
+bool Rasterizer::setScene( const vector<Primitive *> &primitives )
+{
+	triangles.clear();
+	supported = false;
+
+	for ( Primitive *p : primitives )
+	{
+		// Removed primitives keep their id, they are skipped while rasterizing
+		if ( p == nullptr )
+		{
+			triangles.push_back( nullptr );
+			continue;
+		}
+
+		Triangle *tri = dynamic_cast<Triangle *>( p );
+		if ( tri == nullptr )
+		{
+			// Spheres are not rasterized, the caller keeps tracing primary rays instead
+			triangles.clear();
+			return false;
+		}
+
+		triangles.push_back( tri );
+	}
+
+	setups.resize( triangles.size() );
+	supported = !triangles.empty();
+	return supported;
+}
+
+void Rasterizer::render( const Camera &cam, float jitterX, float jitterY )
+{
+	this->cam = cam;
+	this->jitterX = jitterX;
+	this->jitterY = jitterY;
+
+	// Unnormalized primary ray direction as a linear function of the pixel, matching Camera::getPinholeRay
+	float k = cam.focusDistance * 0.5f / cam.focalLength;
+	dirX = cam.right * ( k / float( SCRWIDTH ) );
+	dirY = cam.up * ( k / float( SCRHEIGHT ) );
+	dirOrigin = cam.forward * cam.focusDistance - ( cam.right + cam.up ) * ( 0.5f * k ) + dirX * jitterX + dirY * jitterY;
+
+	vector<char> visible( triangles.size() );
+
+#pragma omp parallel for
+	for ( int i = 0; i < (int)triangles.size(); i++ )
+	{
+		visible[i] = triangles[i] != nullptr && setupTriangle( *triangles[i], setups[i] );
+	}
+
+	// Bin triangles into the tiles their bounds overlap
+	for ( vector<int> &list : tileTriangles )
+	{
+		list.clear();
+	}
+
+	for ( int i = 0; i < (int)triangles.size(); i++ )
+	{
+		if ( !visible[i] )
+		{
+			continue;
+		}
+
+		const TriangleSetup &s = setups[i];
+		for ( int ty = s.minY / TILESIZE; ty <= s.maxY / TILESIZE; ty++ )
+		{
+			for ( int tx = s.minX / TILESIZE; tx <= s.maxX / TILESIZE; tx++ )
+			{
+				tileTriangles[ty * tilesX + tx].push_back( i );
+			}
+		}
+	}
+
+#pragma omp parallel for schedule( dynamic )
+	for ( int i = 0; i < (int)tileTriangles.size(); i++ )
+	{
+		rasterizeTile( i );
+	}
+}
+
+Hit Rasterizer::getHit( unsigned x, unsigned y ) const
+{
+	const GBufferSample &sample = gbuffer[y * SCRWIDTH + x];
+
+	if ( sample.primitiveId == -1 )
+	{
+		return Hit();
+	}
+
+	Ray r = cam.getPinholeRay( float( x ) + jitterX, float( y ) + jitterY );
+	return triangles[sample.primitiveId]->hitAt( r, sample.t, sample.b0, sample.b1 );
+}
+
+bool Rasterizer::setupTriangle( const Triangle &tri, TriangleSetup &setup ) const
+{
+	// Conservative pixel bounds from the projected verteces
+	const vec3 verts[3] = {tri.v0, tri.v1, tri.v2};
+	const float scale = 2.f * cam.focalLength;
+	float minSx = FLT_MAX, minSy = FLT_MAX, maxSx = -FLT_MAX, maxSy = -FLT_MAX;
+	int behind = 0;
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		vec3 d = verts[i] - cam.origin;
+		float depth = d.dot( cam.forward );
+
+		if ( depth <= EPSILON )
+		{
+			behind++;
+			continue;
+		}
+
+		float sx = ( d.dot( cam.right ) / depth * scale + 0.5f ) * float( SCRWIDTH );
+		float sy = ( d.dot( cam.up ) / depth * scale + 0.5f ) * float( SCRHEIGHT );
+
+		minSx = min( minSx, sx );
+		maxSx = max( maxSx, sx );
+		minSy = min( minSy, sy );
+		maxSy = max( maxSy, sy );
+	}
+
+	if ( behind == 3 )
+	{
+		return false;
+	}
+
+	if ( behind > 0 )
+	{
+		// Crosses the camera plane, the projected bounds are unbounded
+		setup.minX = 0;
+		setup.minY = 0;
+		setup.maxX = SCRWIDTH - 1;
+		setup.maxY = SCRHEIGHT - 1;
+	}
+	else
+	{
+		// Pixel x samples at x + jitterX, one pixel of margin against rounding
+		setup.minX = max( 0, (int)floorf( clamp( minSx - jitterX, -1.f, float( SCRWIDTH ) ) ) - 1 );
+		setup.maxX = min( SCRWIDTH - 1, (int)ceilf( clamp( maxSx - jitterX, -1.f, float( SCRWIDTH ) ) ) + 1 );
+		setup.minY = max( 0, (int)floorf( clamp( minSy - jitterY, -1.f, float( SCRHEIGHT ) ) ) - 1 );
+		setup.maxY = min( SCRHEIGHT - 1, (int)ceilf( clamp( maxSy - jitterY, -1.f, float( SCRHEIGHT ) ) ) + 1 );
+
+		if ( setup.minX > setup.maxX || setup.minY > setup.maxY )
+		{
+			return false;
+		}
+	}
+
+	// Triangle::hit with the shared ray origin factored out:
+	// a = d . ( e2 x e1 ), b0 * a = d . ( e2 x s ), b1 * a = d . ( s x e1 ), t * a = e2 . ( s x e1 )
+	const vec3 e1 = tri.v1 - tri.v0;
+	const vec3 e2 = tri.v2 - tri.v0;
+	const vec3 s = cam.origin - tri.v0;
+	const vec3 r = s.cross( e1 );
+
+	const vec3 na = e2.cross( e1 );
+	const vec3 nb0 = e2.cross( s );
+
+	setup.a[0] = dirOrigin.dot( na );
+	setup.a[1] = dirX.dot( na );
+	setup.a[2] = dirY.dot( na );
+
+	setup.b0[0] = dirOrigin.dot( nb0 );
+	setup.b0[1] = dirX.dot( nb0 );
+	setup.b0[2] = dirY.dot( nb0 );
+
+	setup.b1[0] = dirOrigin.dot( r );
+	setup.b1[1] = dirX.dot( r );
+	setup.b1[2] = dirY.dot( r );
+
+	setup.tNumerator = e2.dot( r );
+
+	return true;
+}
+
+void Rasterizer::rasterizeTile( unsigned tile )
+{
+	const int tileX = ( tile % tilesX ) * TILESIZE;
+	const int tileY = ( tile / tilesX ) * TILESIZE;
+	const int endX = min( tileX + TILESIZE, SCRWIDTH );
+	const int endY = min( tileY + TILESIZE, SCRHEIGHT );
+
+	// The t of each sample doubles as the z-buffer
+	for ( int y = tileY; y < endY; y++ )
+	{
+		for ( int x = tileX; x < endX; x++ )
+		{
+			GBufferSample &sample = gbuffer[y * SCRWIDTH + x];
+			sample.t = FLT_MAX;
+			sample.primitiveId = -1;
+		}
+	}
+
+	for ( int i : tileTriangles[tile] )
+	{
+		const TriangleSetup &s = setups[i];
+		const int x0 = max( s.minX, tileX ), x1 = min( s.maxX + 1, endX );
+		const int y0 = max( s.minY, tileY ), y1 = min( s.maxY + 1, endY );
+
+		for ( int y = y0; y < y1; y++ )
+		{
+			const float fy = float( y );
+			const float aRow = s.a[0] + s.a[2] * fy;
+			const float b0Row = s.b0[0] + s.b0[2] * fy;
+			const float b1Row = s.b1[0] + s.b1[2] * fy;
+
+			for ( int x = x0; x < x1; x++ )
+			{
+				const float fx = float( x );
+				const float a = aRow + s.a[1] * fx;
+
+				// Parallel?
+				if ( abs( a ) <= EPSILON )
+				{
+					continue;
+				}
+
+				const float invA = 1.f / a;
+				const float b0 = ( b0Row + s.b0[1] * fx ) * invA;
+				const float b1 = ( b1Row + s.b1[1] * fx ) * invA;
+
+				if ( b0 < 0.f || b1 < 0.f || 1.f - b0 - b1 < 0.f )
+				{
+					continue;
+				}
+
+				const float t = s.tNumerator * invA;
+				GBufferSample &sample = gbuffer[y * SCRWIDTH + x];
+
+				if ( t >= 0.f && t < sample.t )
+				{
+					sample.t = t;
+					sample.b0 = b0;
+					sample.b1 = b1;
+					sample.primitiveId = i;
+				}
+			}
+		}
+	}
+}
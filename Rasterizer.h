@@ -0,0 +1,61 @@
+#pragma once
+
+// Primary visibility of a single pixel
+struct GBufferSample
+{
+	float t;
+	float b0, b1;	// Barycentric coordinates, same convention as Triangle::hit
+	int primitiveId; // -1 when no triangle covers the pixel
+};
+
+// Tile based, multithreaded rasterizer for the primary hits of a pinhole camera
+// Every pixel is tested with the same equations as Triangle::hit, written as linear functions over the screen.
+// That way no near plane clipping is needed and the hits match the ray traced ones.
+class Rasterizer
+{
+  public:
+	Rasterizer();
+	~Rasterizer();
+
+	// Primitives indexed by id, nullptr for removed ones
+	// Returns false when the scene contains anything other than triangles
+	bool setScene( const vector<Primitive *> &primitives );
+	bool supportsScene() const { return supported; }
+
+	// Fills the G-buffer for sample positions ( x + jitterX, y + jitterY ), see Camera::getPinholeRay
+	void render( const Camera &cam, float jitterX, float jitterY );
+
+	const GBufferSample &getSample( unsigned x, unsigned y ) const { return gbuffer[y * SCRWIDTH + x]; }
+
+	// Full hit for a pixel of the last rendered frame, as if its primary ray was traced
+	Hit getHit( unsigned x, unsigned y ) const;
+
+  private:
+	struct TriangleSetup
+	{
+		// Linear functions f( x, y ) = c[0] + c[1] * x + c[2] * y over the pixels
+		float a[3];
+		float b0[3];
+		float b1[3];
+		float tNumerator;
+
+		// Conservative pixel bounds
+		int minX, minY, maxX, maxY;
+	};
+
+	vector<Triangle *> triangles;
+	vector<TriangleSetup> setups;
+	vector<vector<int>> tileTriangles;
+	unsigned tilesX, tilesY;
+	bool supported;
+
+	GBufferSample *gbuffer;
+
+	// State of the last render() call
+	Camera cam;
+	float jitterX, jitterY;
+	vec3 dirOrigin, dirX, dirY;
+
+	bool setupTriangle( const Triangle &tri, TriangleSetup &setup ) const;
+	void rasterizeTile( unsigned tile );
+};
@@ -1,7 +1,7 @@
 #pragma once
 struct Hit
 {
-	Hit() : hitType( 0 ), t( FLT_MAX ) {}
+	Hit() : hitType( 0 ), t( FLT_MAX ), primitiveId( -1 ), barycentrics( 0.f ) {}
 
 	// World
 	int hitType; // -1 hit from inside; 0 no hit; 1 hit
@@ -13,6 +13,52 @@ struct Hit
 	float u;
 	float v;
 	Material mat;
+
+	// Index of the primitive that was hit, -1 when nothing was hit
+	int primitiveId;
+
+	// Barycentric coordinates, only set for triangles
+	vec2 barycentrics;
+};
+
+// Compact primary hit, so a jittered camera ray only has to be traced once
+struct CachedHit
+{
+	vec3 coordinates;
+	vec3 normal;
+	float t;
+	float u;
+	float v;
+	int hitType;
+	int primitiveId;
+	int materialId;
+};
+
+// Hashed set of the primitives and materials the paths of a pixel touched, one bit per hash bucket
+// False positives only cause an unneeded reset of the pixel
+struct PathSignature
+{
+	uint64 primitives = 0;
+	uint64 materials = 0;
+
+	static uint64 bit( int id ) { return 1ull << ( ( (unsigned)id * 2654435761u ) >> 26 ); }
+
+	void add( int primitiveId, int materialId )
+	{
+		if ( primitiveId != -1 ) primitives |= bit( primitiveId );
+		if ( materialId != -1 ) materials |= bit( materialId );
+	}
+
+	void add( const PathSignature &other )
+	{
+		primitives |= other.primitives;
+		materials |= other.materials;
+	}
+
+	bool overlaps( const PathSignature &other ) const
+	{
+		return ( primitives & other.primitives ) != 0 || ( materials & other.materials ) != 0;
+	}
 };
 
 struct Ray
@@ -27,3 +73,14 @@ struct Ray
 		return origin + t * direction;
 	}
 };
+
+// Up to four rays traced together through the BVH, e.g. the shadow rays of neighbouring shading points
+// towards one light, or rays that share their origin. Lanes are kept both transposed, for the box tests,
+// and as single rays, for the primitive tests in the leaves
+struct RayPacket4
+{
+	vec3x4 origin;
+	vec3x4 direction;
+	Ray rays[4];
+	float maxT[4];
+};
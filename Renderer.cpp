@@ -1,72 +1,619 @@
 #include "precomp.h"
 
-Renderer::Renderer( vector<Primitive *> primitives ) : bvh( BVH( primitives ) )
+// Murmur3 finalizer over both values, for seeds of neighbouring frames and tiles that do not correlate
+static unsigned mixSeed( unsigned a, unsigned b )
+{
+	unsigned h = a ^ ( b * 0x9E3779B9u );
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Random generator - needs to move somewhere else (?)
+// random_device is read once before main, the render threads seed from it and a count of the generators so far
+static const unsigned startupSeed = std::random_device()();
+static std::atomic<unsigned> generatorCount( 0 );
+thread_local std::mt19937 mt( mixSeed( startupSeed, generatorCount++ ) ); // one generator per render thread
+std::uniform_real_distribution<float> uniform_dist( 0.f, 1.f );
+
+#ifdef SORT_BY_MATERIAL
+// Primary hits of the tile a thread is rendering, see Renderer::shadeSorted
+struct MaterialBatch
+{
+	vector<CachedHit> hits;
+	vector<unsigned> pixels;
+	vector<unsigned> order;	  // Batch entries sorted by material, misses first
+	vector<unsigned> buckets; // Counting sort offsets per material, misses at 0
+};
+static thread_local MaterialBatch batch;
+#endif
+
+Renderer::Renderer( vector<Primitive *> primitives ) : scenes( primitives ), scene( nullptr ), sceneQuery( scenes )
 {
 	currentIteration = 1;
+	maxIterations = ITERATIONS;
+
+	seeded = false;
+	seed = 0;
+	frameIndex = 0;
 
 	prebuffer = new vec3[SCRWIDTH * SCRHEIGHT];
+	sampleCount = new unsigned[SCRWIDTH * SCRHEIGHT];
+	signatures = new PathSignature[SCRWIDTH * SCRHEIGHT];
 
 	for ( unsigned i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
 	{
 		prebuffer[i] = vec3( 0.f, 0.f, 0.f );
+		sampleCount[i] = 0;
 	}
 
 	buffer = new Pixel[SCRWIDTH * SCRHEIGHT];
 
-	for ( unsigned y = 0; y < SCRHEIGHT; y += TILESIZE )
+	primaryCache = new CachedHit[SCRWIDTH * SCRHEIGHT * PRIMARYCACHESIZE];
+	cacheIteration = 0;
+	primaryCacheEnabled = true;
+	foveationEnabled = true;
+
+	memoryTracker.allocate( MEM_FRAMEBUFFERS, framebufferBytes() );
+
+	tileSize = tuning.tileSize;
+	for ( unsigned y = 0; y < SCRHEIGHT; y += tileSize )
 	{
-		for ( unsigned x = 0; x < SCRWIDTH; x += TILESIZE )
+		for ( unsigned x = 0; x < SCRWIDTH; x += tileSize )
 		{
 			tuple<int, int> element = make_pair( x, y );
 			tiles.push_back( element );
 		}
 	}
 
-	this->primitives = primitives;
+#ifdef TILE_COST_BALANCE
+	tileCost.assign( tiles.size(), 0.f );
+	tileCostValid = false;
+#endif
+	cropX0 = cropY0 = 0;
+	cropX1 = SCRWIDTH, cropY1 = SCRHEIGHT;
+	setFocus( SCRWIDTH / 2, SCRHEIGHT / 2 );
+
+	// Set up everything that depends on the scene in the first renderFrame()
+	sceneVersion = UINT_MAX;
+	emitterFeatures = 0;
 }
 
 Renderer::~Renderer()
 {
-	for ( unsigned i = 0; i < primitives.size(); i++ )
-	{
-		delete primitives[i];
-	}
-
 	delete[] prebuffer;
 	prebuffer = nullptr;
 
+	delete[] sampleCount;
+	sampleCount = nullptr;
+
+	delete[] signatures;
+	signatures = nullptr;
+
 	delete[] buffer;
 	buffer = nullptr;
+
+	delete[] primaryCache;
+	primaryCache = nullptr;
+
+	memoryTracker.release( MEM_FRAMEBUFFERS, framebufferBytes() );
+}
+
+size_t Renderer::framebufferBytes()
+{
+	return SCRWIDTH * SCRHEIGHT * ( sizeof( vec3 ) + sizeof( unsigned ) + sizeof( PathSignature ) + sizeof( Pixel ) + sizeof( CachedHit ) * PRIMARYCACHESIZE );
 }
 
 void Renderer::renderFrame()
 {
-	if ( currentIteration < ITERATIONS )
+	PROFILE_SCOPE( "renderFrame" );
+
+	// Scene edits are picked up at the iteration boundary. The snapshot stays pinned until the
+	// iteration is done, so committing an edit never has to wait for the render threads.
+	timer stage;
+	scene = scenes.acquire();
+	if ( scene->getVersion() != sceneVersion )
 	{
-#pragma omp parallel for
-		for ( int i = 0; i < tiles.size(); i++ )
+		sceneChanged();
+	}
+	stats.add( STAT_SCENE_US, uint64( stage.elapsed() * 1000.f ) );
+
+	if ( currentIteration < maxIterations )
+	{
+		// Seeded renders draw every random number from a generator seeded by frame and tile,
+		// so they do not depend on which thread renders which tile
+		if ( seeded )
 		{
-			int x = get<0>( tiles[i] );
-			int y = get<1>( tiles[i] );
+			mt.seed( mixSeed( seed, frameIndex ) );
+		}
 
-			for ( unsigned dy = 0; dy < TILESIZE; dy++ )
-			{
-				for ( unsigned dx = 0; dx < TILESIZE; dx++ )
-				{
-					if ( ( x + dx ) < SCRWIDTH && ( y + dy ) < SCRHEIGHT )
-					{
-						prebuffer[( y + dy ) * SCRWIDTH + ( x + dx )] += shootRay( x + dx, y + dy, MAXRAYDEPTH );
-					}
-				}
-			}
+#ifdef PRIMARY_CACHE
+		// Any change to the camera invalidates the cached primary hits
+		if ( !cam.sameView( cacheCam ) )
+		{
+			cacheCam = cam;
+			cacheIteration = 0;
 		}
+
+		// Depth of field randomizes the ray origin, so only a pinhole camera can use the cache
+		const bool useCache = primaryCacheEnabled && cam.aperture == 0.f;
+		const bool fillCache = cacheIteration < PRIMARYCACHESIZE;
+		const unsigned slot = cacheIteration % PRIMARYCACHESIZE;
+#endif
+
+#ifdef RASTERIZE_PRIMARY
+		// Primary rays of a pinhole camera share their origin, so they can be rasterized instead of traced
+		// The AA jitter is shared by all pixels of the iteration
+		bool useRaster = cam.aperture == 0.f && rasterizer.supportsScene();
+#ifdef PRIMARY_CACHE
+		useRaster = useRaster && ( !useCache || fillCache );
+#endif
+		if ( useRaster )
+		{
+			PROFILE_SCOPE( "rasterize" );
+			stage.reset();
+			float jitterX = -1.f + uniform_dist( mt );
+			float jitterY = -1.f + uniform_dist( mt );
+			rasterizer.render( cam, jitterX, jitterY );
+			stats.add( STAT_RASTER_US, uint64( stage.elapsed() * 1000.f ) );
+		}
+#endif
+
+		// Everything the pixels of this frame have in common picks the tile kernel, once
+		unsigned features = emitterFeatures;
+		features |= cam.aperture != 0.f ? KERNEL_DOF : 0;
+#ifdef PRIMARY_CACHE
+		features |= useCache ? ( fillCache ? KERNEL_CACHE_FILL : KERNEL_CACHE_REPLAY ) : 0;
+#else
+		const unsigned slot = 0;
+#endif
+#ifdef RASTERIZE_PRIMARY
+		features |= useRaster ? KERNEL_RASTER : 0;
+#endif
+		const TileKernel kernel = selectKernel( features );
+
+		stage.reset();
+		renderTiles( kernel, features, slot );
+		stats.add( STAT_TILES_US, uint64( stage.elapsed() * 1000.f ) );
+
 		currentIteration++;
+		frameIndex++;
+		stats.gather();
+		PROFILE_SAMPLE();
+#ifdef PERF_COUNTERS
+		perfCounters.gather();
+#endif
+
+#ifdef PRIMARY_CACHE
+		if ( useCache )
+		{
+			cacheIteration++;
+		}
+#endif
 	}
 	else
 	{
 		// Prevent stupidly high framerate
 		Sleep( ( 1.f / MAX_IDLE_FPS ) * 1000 );
 	}
+
+	scenes.release();
+	scene = nullptr;
+	scenes.reclaim();
+}
+
+// One run of tiles per thread. The tiles are dealt out in order of their distance to the focus point, each to the
+// run with the least work so far, so every run starts near the focus point and the centre is not left to one thread.
+// With TILE_COST_BALANCE the work of a tile is its cost as measured in the previous iteration, the cost of a tile
+// barely changes while the view and the kernel stay the same. Otherwise, and in the first iteration after a change,
+// every tile counts the same and the tiles go round robin.
+void Renderer::renderTiles( TileKernel kernel, unsigned features, unsigned slot )
+{
+	const int tileCount = (int)tileOrder.size();
+#ifdef _OPENMP
+	const int threads = omp_get_max_threads();
+#else
+	const int threads = 1;
+#endif
+
+	bool balanced = false;
+#ifdef TILE_COST_BALANCE
+	if ( !cam.sameView( costCam ) || features != costFeatures )
+	{
+		costCam = cam;
+		costFeatures = features;
+		tileCostValid = false;
+	}
+
+	if ( tileCostValid )
+	{
+		float total = 0.f;
+		for ( int tile : tileOrder )
+		{
+			total += tileCost[tile];
+		}
+		balanced = total > 0.f;
+	}
+#endif
+
+	vector<float> work( threads, 0.f );
+	vector<int> tileRun( tileCount );
+	tileRuns.assign( threads + 1, 0 );
+	for ( int i = 0; i < tileCount; i++ )
+	{
+		int run = 0;
+		for ( int t = 1; t < threads; t++ )
+		{
+			if ( work[t] < work[run] )
+			{
+				run = t;
+			}
+		}
+#ifdef TILE_COST_BALANCE
+		work[run] += balanced ? tileCost[tileOrder[i]] : 1.f;
+#else
+		work[run] += 1.f;
+#endif
+		tileRun[i] = run;
+		tileRuns[run + 1]++;
+	}
+
+	// Group the tiles by run, keeping their order within a run
+	for ( int t = 0; t < threads; t++ )
+	{
+		tileRuns[t + 1] += tileRuns[t];
+	}
+	runOrder.resize( tileCount );
+	vector<int> next( tileRuns.begin(), tileRuns.end() - 1 );
+	for ( int i = 0; i < tileCount; i++ )
+	{
+		runOrder[next[tileRun[i]]++] = tileOrder[i];
+	}
+
+	// A smaller team than planned picks up the remaining runs
+#pragma omp parallel for schedule( static, 1 )
+	for ( int run = 0; run < threads; run++ )
+	{
+		for ( int i = tileRuns[run]; i < tileRuns[run + 1]; i++ )
+		{
+#ifdef TILE_COST_BALANCE
+			timer t;
+			( this->*kernel )( runOrder[i], slot, 0 );
+			tileCost[runOrder[i]] = t.elapsed();
+#else
+			( this->*kernel )( runOrder[i], slot, 0 );
+#endif
+		}
+	}
+
+#ifdef TILE_COST_BALANCE
+	tileCostValid = true;
+#endif
+
+#ifdef FOVEATION
+	// While the image is still noisy, e.g. during camera movement, the region the viewer looks at converges first
+	// Extra samples trace their own primary rays, the primary cache and the rasterizer only hold one per iteration
+	if ( foveationEnabled && currentIteration < FOVEAITERATIONS )
+	{
+		const TileKernel extra = selectKernel( features & ~( KERNEL_CACHE_REPLAY | KERNEL_CACHE_FILL | KERNEL_RASTER ) );
+
+		// One work item per tile, its passes accumulate into the same pixels and run in order
+#pragma omp parallel for schedule( dynamic )
+		for ( int i = 0; i < (int)foveaTiles.size(); i++ )
+		{
+			for ( unsigned pass = 1; pass <= foveaTiles[i].second; pass++ )
+			{
+				( this->*extra )( foveaTiles[i].first, slot, pass );
+			}
+		}
+	}
+#endif
+}
+
+void Renderer::setFocus( int x, int y )
+{
+	focusX = x;
+	focusY = y;
+	updateTileOrder();
+}
+
+void Renderer::setCrop( int x0, int y0, int x1, int y1 )
+{
+	x0 = max( x0, 0 ), y0 = max( y0, 0 );
+	x1 = min( x1, SCRWIDTH ), y1 = min( y1, SCRHEIGHT );
+
+	if ( x1 <= x0 || y1 <= y0 )
+	{
+		x0 = y0 = 0;
+		x1 = SCRWIDTH, y1 = SCRHEIGHT;
+	}
+
+	cropX0 = x0, cropY0 = y0, cropX1 = x1, cropY1 = y1;
+	updateTileOrder();
+
+	// The primary hits of tiles that were outside the crop are out of date, and their cost is unknown
+	cacheIteration = 0;
+#ifdef TILE_COST_BALANCE
+	tileCostValid = false;
+#endif
+}
+
+bool Renderer::getCrop( int &x0, int &y0, int &x1, int &y1 ) const
+{
+	x0 = cropX0, y0 = cropY0, x1 = cropX1, y1 = cropY1;
+	return x0 != 0 || y0 != 0 || x1 != SCRWIDTH || y1 != SCRHEIGHT;
+}
+
+// The tiles inside the crop by the distance of their centre to the focus point. With FOVEATION, tiles within
+// FOVEARADIUS get up to FOVEASAMPLES - 1 extra samples, fewer towards the edge of the radius
+void Renderer::updateTileOrder()
+{
+	vector<float> distance( tiles.size() );
+	tileOrder.clear();
+	for ( size_t i = 0; i < tiles.size(); i++ )
+	{
+		const int x0 = get<0>( tiles[i] ), x1 = min( x0 + (int)tileSize, SCRWIDTH );
+		const int y0 = get<1>( tiles[i] ), y1 = min( y0 + (int)tileSize, SCRHEIGHT );
+		const float x = ( x0 + x1 ) * 0.5f - focusX;
+		const float y = ( y0 + y1 ) * 0.5f - focusY;
+		distance[i] = sqrtf( x * x + y * y );
+
+		if ( x0 < cropX1 && x1 > cropX0 && y0 < cropY1 && y1 > cropY0 )
+		{
+			tileOrder.push_back( (int)i );
+		}
+	}
+	stable_sort( tileOrder.begin(), tileOrder.end(), [&distance]( int a, int b ) { return distance[a] < distance[b]; } );
+
+#ifdef FOVEATION
+	foveaTiles.clear();
+	for ( int tile : tileOrder )
+	{
+		const float weight = max( 0.f, 1.f - distance[tile] / ( FOVEARADIUS * SCRHEIGHT ) );
+		const unsigned passes = unsigned( ( FOVEASAMPLES - 1 ) * weight + 0.5f );
+		if ( passes > 0 )
+		{
+			foveaTiles.push_back( make_pair( tile, passes ) );
+		}
+	}
+#endif
+}
+
+// Everything derived from the previous snapshot is outdated
+void Renderer::sceneChanged()
+{
+	PROFILE_SCOPE( "sceneChanged" );
+
+	if ( !resetChangedPixels() )
+	{
+		invalidatePrebuffer();
+	}
+
+	sceneVersion = scene->getVersion();
+
+	rasterizer.setScene( scene->getPrimitives() );
+	occluderCache.assign( MAXTHREADS * scene->getLights().size(), -1 );
+	cacheIteration = 0;
+#ifdef TILE_COST_BALANCE
+	tileCostValid = false;
+#endif
+
+	emitterFeatures = KERNEL_SPHERE_LIGHTS | KERNEL_TRIANGLE_LIGHTS;
+	for ( Primitive *light : scene->getLights() )
+	{
+		emitterFeatures &= dynamic_cast<Sphere *>( light ) ? ~0u : ~KERNEL_SPHERE_LIGHTS;
+		emitterFeatures &= dynamic_cast<Triangle *>( light ) ? ~0u : ~KERNEL_TRIANGLE_LIGHTS;
+	}
+}
+
+template <size_t... Features>
+Renderer::TileKernel Renderer::selectKernel( unsigned features, index_sequence<Features...> )
+{
+	static const TileKernel kernels[] = {&Renderer::renderTile<Features>...};
+	return kernels[features];
+}
+
+Renderer::TileKernel Renderer::selectKernel( unsigned features )
+{
+	return selectKernel( features, make_index_sequence<KERNEL_VARIANTS>() );
+}
+
+template <unsigned Features>
+void Renderer::renderTile( int tile, unsigned slot, unsigned pass )
+{
+	const unsigned x = get<0>( tiles[tile] );
+	const unsigned y = get<1>( tiles[tile] );
+	PROFILE_TILE( "tile", x, y );
+	PERF_SCOPE( PERF_SHADE );
+
+	if ( seeded )
+	{
+		mt.seed( mixSeed( mixSeed( seed, frameIndex ), tile + pass * (unsigned)tiles.size() ) );
+	}
+
+	const unsigned endX = min( x + tileSize, (unsigned)SCRWIDTH );
+	const unsigned endY = min( y + tileSize, (unsigned)SCRHEIGHT );
+
+#ifdef SORT_BY_MATERIAL
+	// Trace the whole tile first, shading follows per material
+	batch.hits.resize( tileSize * tileSize );
+	batch.pixels.resize( tileSize * tileSize );
+	unsigned count = 0;
+#endif
+
+	for ( unsigned py = y; py < endY; py++ )
+	{
+		for ( unsigned px = x; px < endX; px++ )
+		{
+			unsigned index = py * SCRWIDTH + px;
+			sampleCount[index]++;
+
+#ifdef SORT_BY_MATERIAL
+			batch.pixels[count] = index;
+			if ( Features & KERNEL_CACHE_REPLAY )
+			{
+				batch.hits[count++] = primaryCache[index * PRIMARYCACHESIZE + slot];
+				continue;
+			}
+#else
+			if ( Features & KERNEL_CACHE_REPLAY )
+			{
+				PROFILE_ACCUMULATE( PROFILE_SHADING );
+				prebuffer[index] += shade<Features>( restoreHit( primaryCache[index * PRIMARYCACHESIZE + slot] ), MAXRAYDEPTH, signatures[index] );
+				continue;
+			}
+#endif
+
+			Hit h;
+			{
+				PROFILE_ACCUMULATE( PROFILE_PRIMARY );
+				stats.add( STAT_PRIMARY_RAYS );
+				h = Features & KERNEL_RASTER ? rasterizer.getHit( px, py ) : scene->getBVH().intersect( primaryRay<Features>( px, py ) );
+			}
+
+#ifdef SORT_BY_MATERIAL
+			batch.hits[count++] = cacheHit( h );
+			if ( Features & KERNEL_CACHE_FILL )
+			{
+				primaryCache[index * PRIMARYCACHESIZE + slot] = batch.hits[count - 1];
+			}
+#else
+			if ( Features & KERNEL_CACHE_FILL )
+			{
+				primaryCache[index * PRIMARYCACHESIZE + slot] = cacheHit( h );
+			}
+
+			PROFILE_ACCUMULATE( PROFILE_SHADING );
+			prebuffer[index] += shade<Features>( h, MAXRAYDEPTH, signatures[index] );
+#endif
+		}
+	}
+
+#ifdef SORT_BY_MATERIAL
+	PROFILE_ACCUMULATE( PROFILE_SHADING );
+	shadeSorted<Features>( count );
+#endif
+}
+
+#ifdef SORT_BY_MATERIAL
+// Shades the batch of renderTile one material at a time, so the loop over a bucket only touches one material
+// and, with direct lighting, Lambertian hits go through directLight4 four at a time
+template <unsigned Features>
+void Renderer::shadeSorted( unsigned count )
+{
+	const vector<Material> &materials = scene->getMaterials();
+
+	// Stable counting sort, a bucket keeps the scanline order of its pixels
+	batch.buckets.assign( materials.size() + 2, 0 );
+	for ( unsigned i = 0; i < count; i++ )
+	{
+		batch.buckets[batch.hits[i].materialId + 2]++;
+	}
+	for ( size_t m = 2; m < batch.buckets.size(); m++ )
+	{
+		batch.buckets[m] += batch.buckets[m - 1];
+	}
+	batch.order.resize( count );
+	for ( unsigned i = 0; i < count; i++ )
+	{
+		batch.order[batch.buckets[batch.hits[i].materialId + 1]++] = i;
+	}
+
+	// Placing the entries moved every start to the end of its bucket, misses end at buckets[0] and shade to black
+	for ( size_t m = 0; m < materials.size(); m++ )
+	{
+		const Material &mat = materials[m];
+		unsigned k = batch.buckets[m];
+		const unsigned end = batch.buckets[m + 1];
+
+		if ( mat.type == EMIT_MAT )
+		{
+			for ( ; k < end; k++ )
+			{
+				const CachedHit &hit = batch.hits[batch.order[k]];
+				const unsigned index = batch.pixels[batch.order[k]];
+				signatures[index].add( hit.primitiveId, hit.materialId );
+				prebuffer[index] += mat.albedo;
+			}
+			continue;
+		}
+
+#ifdef DIRECT_LIGHTING
+		if ( mat.type == LAMBERTIAN_MAT )
+		{
+			for ( ; k + 4 <= end; k += 4 )
+			{
+				const CachedHit *hits[4];
+				PathSignature *laneSignatures[4];
+				vec3 result[4];
+
+				for ( int lane = 0; lane < 4; lane++ )
+				{
+					hits[lane] = &batch.hits[batch.order[k + lane]];
+					laneSignatures[lane] = &signatures[batch.pixels[batch.order[k + lane]]];
+					laneSignatures[lane]->add( hits[lane]->primitiveId, hits[lane]->materialId );
+				}
+
+				directLight4<Features>( hits, mat, laneSignatures, result );
+
+				// The bounces stay single rays: each lane draws its own random direction, so four of them share
+				// neither origin nor direction, and only the shadow rays towards one light are coherent
+				for ( int lane = 0; lane < 4; lane++ )
+				{
+					result[lane] += indirectLight<Features>( restoreHit( *hits[lane] ), MAXRAYDEPTH, *laneSignatures[lane] );
+					prebuffer[batch.pixels[batch.order[k + lane]]] += result[lane];
+				}
+			}
+		}
+#endif
+
+		for ( ; k < end; k++ )
+		{
+			const unsigned index = batch.pixels[batch.order[k]];
+			prebuffer[index] += shade<Features>( restoreHit( batch.hits[batch.order[k]] ), MAXRAYDEPTH, signatures[index] );
+		}
+	}
+}
+#endif
+
+// Only restart the pixels whose paths touched a changed primitive or material
+// Returns false when that is not enough, e.g. for added or moved geometry, which can show up anywhere
+bool Renderer::resetChangedPixels()
+{
+	vector<SceneChange> changes;
+	if ( sceneVersion == UINT_MAX || !scene->changesSince( sceneVersion, changes ) )
+	{
+		return false;
+	}
+
+	PathSignature changed;
+	for ( const SceneChange &c : changes )
+	{
+		if ( c.geometry )
+		{
+			return false;
+		}
+
+		changed.add( c.primitiveId, c.materialId );
+	}
+
+#pragma omp parallel for
+	for ( int i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
+	{
+		if ( signatures[i].overlaps( changed ) )
+		{
+			prebuffer[i] = vec3( 0.f, 0.f, 0.f );
+			sampleCount[i] = 0;
+			signatures[i] = PathSignature();
+		}
+	}
+
+	// The untouched pixels keep their samples, but the reset ones need the full iteration budget again
+	currentIteration = 1;
+	return true;
 }
 
 void Renderer::invalidatePrebuffer()
@@ -74,6 +621,8 @@ void Renderer::invalidatePrebuffer()
 	for ( size_t i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
 	{
 		prebuffer[i] = vec3( 0.f, 0.f, 0.f );
+		sampleCount[i] = 0;
+		signatures[i] = PathSignature();
 	}
 
 	currentIteration = 1;
@@ -81,7 +630,11 @@ void Renderer::invalidatePrebuffer()
 
 void Renderer::setCamera( Camera cam )
 {
+	invalidatePrebuffer();
 	this->cam = cam;
+
+	cacheCam = cam;
+	cacheIteration = 0;
 }
 
 Camera *Renderer::getCamera()
@@ -118,27 +671,214 @@ void Renderer::changeAperture( float deltaAperture )
 void Renderer::focusCam()
 {
 	invalidatePrebuffer();
-	Hit h = bvh.intersect( cam.focusRay() );
+
+	const Scene *s = scenes.acquire();
+	Hit h = s->getBVH().intersect( cam.focusRay() );
+	scenes.release();
 
 	cam.focusDistance = h.t;
 }
 
+const SceneQuery &Renderer::getSceneQuery() const
+{
+	return sceneQuery;
+}
+
+const Statistics &Renderer::getStatistics() const
+{
+	return stats;
+}
+
+SceneManager &Renderer::getSceneManager()
+{
+	return scenes;
+}
+
+size_t Renderer::getLightCount()
+{
+	const Scene *s = scenes.acquire();
+	size_t count = s->getLights().size();
+	scenes.release();
+
+	return count;
+}
+
 Pixel *Renderer::getOutput() const
 {
-	// currentSample - 1 because it is increased in the renderFrame() function in preparation of the next frame.
-	// Unfortunately, we are getting the current frame, so we get currentSample - 1.
-	float importance = 1.f / float( currentIteration - 1 );
-	for ( unsigned i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
+	PROFILE_SCOPE( "getOutput" );
+	PERF_SCOPE( PERF_RESOLVE );
+
+	// Pixels are reset individually after scene edits, so each one has its own sample count
+	// Eight pixels at a time, the same operations as rgb( gammaCorrect( ... ) ) so the output is identical
+	unsigned i = 0;
+	for ( ; i + 8 <= SCRWIDTH * SCRHEIGHT; i += 8 )
 	{
+		float importance[8];
+		for ( int j = 0; j < 8; j++ )
+		{
+			importance[j] = sampleCount[i + j] > 0 ? 1.f / float( sampleCount[i + j] ) : 0.f;
+		}
+
+		packPixels( saturate( sqrt( vec3x8::load( prebuffer + i ) * float8::load( importance ) ) ), buffer + i );
+	}
+
+	for ( ; i < SCRWIDTH * SCRHEIGHT; i++ )
+	{
+		float importance = sampleCount[i] > 0 ? 1.f / float( sampleCount[i] ) : 0.f;
 		buffer[i] = rgb( gammaCorrect( prebuffer[i] * importance ) );
 	}
 
 	return buffer;
 }
 
+void Renderer::getRadiance( vec3 *radiance ) const
+{
+	for ( unsigned i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
+	{
+		radiance[i] = sampleCount[i] > 0 ? prebuffer[i] * ( 1.f / float( sampleCount[i] ) ) : vec3( 0.f, 0.f, 0.f );
+	}
+}
+
+unsigned Renderer::getIteration() const
+{
+	return currentIteration - 1;
+}
+
+unsigned Renderer::getMaxIterations() const
+{
+	return maxIterations - 1;
+}
+
+void Renderer::setMaxIterations( unsigned iterations )
+{
+	maxIterations = iterations + 1;
+}
+
+void Renderer::setSeed( unsigned seed )
+{
+	this->seed = seed;
+	seeded = true;
+	frameIndex = 0;
+}
+
+void Renderer::setPrimaryCache( bool enabled )
+{
+	primaryCacheEnabled = enabled;
+	cacheIteration = 0;
+}
+
+void Renderer::setFoveation( bool enabled )
+{
+	foveationEnabled = enabled;
+}
+
+int Renderer::getTileCount() const
+{
+	return (int)tiles.size();
+}
+
+void Renderer::getTileBounds( int tile, int &x0, int &y0, int &x1, int &y1 ) const
+{
+	x0 = get<0>( tiles[tile] );
+	y0 = get<1>( tiles[tile] );
+	x1 = min( x0 + (int)tileSize, SCRWIDTH );
+	y1 = min( y0 + (int)tileSize, SCRHEIGHT );
+}
+
+// Iteration i of the tile is seeded as in renderFrame() with frameIndex i, on the pixels of the tile only
+void Renderer::renderTileSamples( int tile, unsigned first, unsigned count, vec3 *sum )
+{
+	scene = scenes.acquire();
+	if ( scene->getVersion() != sceneVersion )
+	{
+		sceneChanged();
+	}
+
+	const unsigned features = emitterFeatures | ( cam.aperture != 0.f ? KERNEL_DOF : 0 );
+	const TileKernel kernel = selectKernel( features );
+
+	// The kernel accumulates into the buffers of the frame, what they held before is put back afterwards
+	int x0, y0, x1, y1;
+	getTileBounds( tile, x0, y0, x1, y1 );
+	vector<vec3> keptSums;
+	vector<unsigned> keptCounts;
+	vector<PathSignature> keptSignatures;
+	for ( int y = y0; y < y1; y++ )
+	{
+		for ( int x = x0; x < x1; x++ )
+		{
+			const unsigned index = y * SCRWIDTH + x;
+			keptSums.push_back( prebuffer[index] );
+			keptCounts.push_back( sampleCount[index] );
+			keptSignatures.push_back( signatures[index] );
+			prebuffer[index] = vec3( 0.f, 0.f, 0.f );
+			sampleCount[index] = 0;
+		}
+	}
+
+	const unsigned frame = frameIndex;
+	for ( unsigned i = 0; i < count; i++ )
+	{
+		frameIndex = first + i;
+		( this->*kernel )( tile, 0, 0 );
+	}
+	frameIndex = frame;
+
+	size_t kept = 0;
+	for ( int y = y0; y < y1; y++ )
+	{
+		for ( int x = x0; x < x1; x++, kept++ )
+		{
+			const unsigned index = y * SCRWIDTH + x;
+			*sum++ = prebuffer[index];
+			prebuffer[index] = keptSums[kept];
+			sampleCount[index] = keptCounts[kept];
+			signatures[index] = keptSignatures[kept];
+		}
+	}
+
+	scenes.release();
+	scene = nullptr;
+	scenes.reclaim();
+}
+
+void Renderer::addTileSamples( int tile, unsigned count, const vec3 *sum )
+{
+	int x0, y0, x1, y1;
+	getTileBounds( tile, x0, y0, x1, y1 );
+	for ( int y = y0; y < y1; y++ )
+	{
+		for ( int x = x0; x < x1; x++ )
+		{
+			prebuffer[y * SCRWIDTH + x] += *sum++;
+			sampleCount[y * SCRWIDTH + x] += count;
+		}
+	}
+}
+
+template <unsigned Features>
+Ray Renderer::primaryRay( unsigned x, unsigned y ) const
+{
+	if ( !( Features & KERNEL_DOF ) )
+	{
+		// getRay with aperture 0 without drawing the lens sample
+		const float jitterX = uniform_dist( mt );
+		const float jitterY = uniform_dist( mt );
+		return cam.getPinholeRay( float( x ) + ( -1.f + jitterX ), float( y ) + ( -1.f + jitterY ) );
+	}
+
+	// One at a time, the evaluation order of function arguments is unspecified
+	const float lensAngle = uniform_dist( mt );
+	const float lensRadius = uniform_dist( mt );
+	const float jitterX = uniform_dist( mt );
+	const float jitterY = uniform_dist( mt );
+
+	return cam.getRay( x, y, lensAngle, lensRadius, jitterX, jitterY );
+}
+
 vec3 Renderer::shootRay( unsigned x, unsigned y, unsigned depth ) const
 {
-	Ray r = cam.getRay( x, y );
+	Ray r = primaryRay<KERNEL_GENERIC>( x, y );
 	return shootRay( r, depth );
 }
 
@@ -165,11 +905,6 @@ __inline void clampFloat( float &val, float lo, float hi )
 //	return r;
 //}
 
-// Random generator - needs to move somewhere else (?)
-std::random_device rd;
-std::mt19937 mt( rd() );
-std::uniform_real_distribution<float> uniform_dist( 0.f, 1.f );
-
 vec3 getPointOnHemi()
 {
 	float r1 = uniform_dist( mt );
@@ -182,50 +917,41 @@ vec3 getPointOnHemi()
 	return point;
 }
 
+// The construction that used to be here divided by zero for normals along the x axis
 void createLocalCoordinateSystem( const vec3 &N, vec3 &Nt, vec3 &Nb )
 {
-	// This came out of my head - maybe there is better option
-	// However, two other things tested did not work (scratchapixel & gpu blog)
-	if ( abs( N.z ) > EPSILON )
-	{
-		Nt.x = 1.5 * N.x; // arbitary
-		Nt.y = 1.5 * N.y; // arbitary
-		Nt.z = -( Nt.x * N.x + Nt.y * N.y ) / N.z;
-	}
-	else if ( abs( N.y ) > EPSILON )
-	{
-		Nt.x = 1.5 * N.x; // arbitary
-		Nt.z = 1.5 * N.z; // arbitary
-		Nt.y = -( Nt.x * N.x + Nt.z * N.z ) / N.y;
-	}
-	else
-	{
-		Nt.y = 1.5 * N.y; // arbitary
-		Nt.z = 1.5 * N.z; // arbitary
-		Nt.x = -( Nt.y * N.y + Nt.z * N.z ) / N.x;
-	}
-	Nt = normalize( Nt );
-	Nb = normalize( cross( N, Nt ) );
+	orthonormalBasis( N, Nt, Nb );
 }
 
 vec3 Renderer::shootRay( const Ray &r, unsigned depth ) const
 {
-	vec3 directDiffuse = vec3( 0.f, 0.f, 0.f );
-
-	Hit closestHit = bvh.intersect( r );
+	PathSignature signature;
+	return shade<KERNEL_GENERIC>( scene->getBVH().intersect( r ), depth, signature );
+}
 
+template <unsigned Features>
+vec3 Renderer::shade( const Hit &closestHit, unsigned depth, PathSignature &signature ) const
+{
 	// No hit
 	if ( closestHit.t == FLT_MAX )
 	{
 		return vec3( 0.f, 0.f, 0.f );
 	}
 
+	signature.add( closestHit.primitiveId, closestHit.mat.id );
+
 	// Closest hit is light source
 	if ( closestHit.mat.type == EMIT_MAT ) return closestHit.mat.albedo;
 
-	// Create the local coordinate system of the hit point
+#ifdef DIRECT_LIGHTING
+	return directLight<Features>( closestHit, signature ) + indirectLight<Features>( closestHit, depth, signature );
+#else
+	vec3 directDiffuse = vec3( 0.f, 0.f, 0.f );
+
+	// Create the local coordinate system of the hit point, on the side the ray arrived from
+	const vec3 normal = closestHit.hitType < 0 ? -closestHit.normal : closestHit.normal;
 	vec3 Nt, Nb;
-	createLocalCoordinateSystem( closestHit.normal, Nt, Nb );
+	createLocalCoordinateSystem( normal, Nt, Nb );
 
 	for ( int i = 0; i < SAMPLES; ++i )
 	{
@@ -235,21 +961,27 @@ vec3 Renderer::shootRay( const Ray &r, unsigned depth ) const
 		// Transform point vector to the local coordinate system of the hit point
 		// https://www.scratchapixel.com/lessons/3d-basic-rendering/global-illumination-path-tracing/global-illumination-path-tracing-practical-implementation
 		vec3 newdir(
-			pointOnHemi.x * Nb.x + pointOnHemi.y * closestHit.normal.x + pointOnHemi.z * Nt.x,
-			pointOnHemi.x * Nb.y + pointOnHemi.y * closestHit.normal.y + pointOnHemi.z * Nt.y,
-			pointOnHemi.x * Nb.z + pointOnHemi.y * closestHit.normal.z + pointOnHemi.z * Nt.z );
+			pointOnHemi.x * Nb.x + pointOnHemi.y * normal.x + pointOnHemi.z * Nt.x,
+			pointOnHemi.x * Nb.y + pointOnHemi.y * normal.y + pointOnHemi.z * Nt.y,
+			pointOnHemi.x * Nb.z + pointOnHemi.y * normal.z + pointOnHemi.z * Nt.z );
 
-		// Diffused ray with the calculated random direction and origin same as the hit point
+		// Diffused ray with the calculated random direction, just off the hit point
 		Ray diffray;
 		diffray.direction = normalize( newdir );
-		diffray.origin = closestHit.coordinates;
+		diffray.origin = closestHit.coordinates + REFLECTIONBIAS * diffray.direction;
 
 		// Cast the random ray and find new intersection
+		stats.add( STAT_DIFFUSE_RAYS );
 		Hit newHit;
 		newHit.t = FLT_MAX;
 
-		for ( Primitive *p : primitives )
+		for ( Primitive *p : scene->getPrimitives() )
 		{
+			if ( p == nullptr )
+			{
+				continue;
+			}
+
 			Hit tmp = p->hit( diffray );
 			if ( tmp.hitType != 0 )
 			{
@@ -263,19 +995,303 @@ vec3 Renderer::shootRay( const Ray &r, unsigned depth ) const
 		// No hit for the diffused ray
 		if ( newHit.t == FLT_MAX )
 		{
-			return vec3( 0.f, 0.f, 0.f );
+			continue;
 		}
 
+		signature.add( newHit.primitiveId, newHit.mat.id );
+
 		// Does diffused ray hit a light source?
 		if ( newHit.mat.type == EMIT_MAT )
 		{
 			vec3 BRDF = closestHit.mat.albedo * ( 1 / PI );
-			vec3 cos_i = dot( diffray.direction, closestHit.normal );
-			directDiffuse = BRDF * newHit.mat.emission * cos_i;
+			vec3 cos_i = dot( diffray.direction, normal );
+			directDiffuse += BRDF * newHit.mat.emission * cos_i;
 		}
 	}
 
 	return directDiffuse * 2 * ( PI / SAMPLES );
+#endif
+}
+
+// Direction towards a random point of the light, see Primitive::sampleDirection
+// Lights of a single primitive type skip the virtual call
+template <unsigned Features>
+static float sampleLight( const Primitive *light, const vec3 &p, vec3 &direction, float &distance )
+{
+	const float u1 = uniform_dist( mt );
+	const float u2 = uniform_dist( mt );
+	return Features & KERNEL_SPHERE_LIGHTS	 ? static_cast<const Sphere *>( light )->Sphere::sampleDirection( p, u1, u2, direction, distance )
+		   : Features & KERNEL_TRIANGLE_LIGHTS ? static_cast<const Triangle *>( light )->Triangle::sampleDirection( p, u1, u2, direction, distance )
+											   : light->sampleDirection( p, u1, u2, direction, distance );
+}
+
+// One shadow ray per light towards a random point of it, weighted by the inverse of the density of its direction
+template <unsigned Features>
+vec3 Renderer::directLight( const Hit &closestHit, PathSignature &signature ) const
+{
+	vec3 result = vec3( 0.f, 0.f, 0.f );
+	vec3 BRDF = closestHit.mat.albedo * ( 1 / PI );
+	const vector<Primitive *> &lights = scene->getLights();
+
+	// The hemisphere on the side the ray arrived from, as in indirectLight()
+	const vec3 normal = closestHit.hitType < 0 ? -closestHit.normal : closestHit.normal;
+
+	for ( size_t i = 0; i < lights.size(); i++ )
+	{
+		vec3 toLight;
+		float distance;
+		const float pdf = sampleLight<Features>( lights[i], closestHit.coordinates, toLight, distance );
+
+		float cos_i = dot( toLight, normal );
+		if ( !( pdf > 0.f ) || cos_i <= 0.f )
+		{
+			continue;
+		}
+
+		Ray shadowRay;
+		shadowRay.origin = closestHit.coordinates + SHADOWBIAS * toLight;
+		shadowRay.direction = toLight;
+
+		// The light matters whether it is blocked or not, and so does whatever blocks it
+		signature.add( lights[i]->id, lights[i]->mat.id );
+
+		int occluder = -1;
+		if ( isOccluded( shadowRay, distance, i, occluder ) )
+		{
+			signature.add( occluder, -1 );
+			continue;
+		}
+
+		result += BRDF * lights[i]->mat.emission * ( cos_i / pdf );
+	}
+
+	return result;
+}
+
+// One bounce in a uniformly sampled direction, continued until depth runs out or Russian roulette ends the path
+// Emitters the bounce finds add nothing, directLight() already sampled them at this hit
+template <unsigned Features>
+vec3 Renderer::indirectLight( const Hit &closestHit, unsigned depth, PathSignature &signature ) const
+{
+	// The path survives with the probability that the surface reflects, survivors are weighted up to match
+	const vec3 &albedo = closestHit.mat.albedo;
+	const float survival = min( 1.f, max( albedo.x, max( albedo.y, albedo.z ) ) );
+	if ( depth <= 1 || uniform_dist( mt ) >= survival )
+	{
+		return vec3( 0.f, 0.f, 0.f );
+	}
+
+	// The hemisphere on the side the ray arrived from
+	const vec3 normal = closestHit.hitType < 0 ? -closestHit.normal : closestHit.normal;
+	vec3 Nt, Nb;
+	createLocalCoordinateSystem( normal, Nt, Nb );
+
+	const vec3 pointOnHemi = getPointOnHemi();
+	Ray bounce;
+	bounce.direction = normalize( pointOnHemi.x * Nb + pointOnHemi.y * normal + pointOnHemi.z * Nt );
+	bounce.origin = closestHit.coordinates + REFLECTIONBIAS * bounce.direction;
+
+	stats.add( STAT_DIFFUSE_RAYS );
+	const Hit next = scene->getBVH().intersect( bounce );
+	if ( next.t == FLT_MAX )
+	{
+		return vec3( 0.f, 0.f, 0.f );
+	}
+
+	signature.add( next.primitiveId, next.mat.id );
+	if ( next.mat.type == EMIT_MAT )
+	{
+		return vec3( 0.f, 0.f, 0.f );
+	}
+
+	const vec3 incoming = directLight<Features>( next, signature ) + indirectLight<Features>( next, depth - 1, signature );
+
+	// Lambertian BRDF albedo / pi over the uniform hemisphere pdf 1 / (2 pi)
+	return albedo * incoming * ( 2.f * dot( bounce.direction, normal ) / survival );
+}
+
+#if defined( SORT_BY_MATERIAL ) && defined( DIRECT_LIGHTING )
+// directLight of four hits with the same material, the light samples are drawn per hit, their weights are
+// computed four wide and the shadow rays towards a light are traced as one packet. The result of every hit is
+// distributed as that of directLight
+template <unsigned Features>
+void Renderer::directLight4( const CachedHit *const *hits, const Material &mat, PathSignature *const *signatures, vec3 *result ) const
+{
+	const vec3x4 coordinates( hits[0]->coordinates, hits[1]->coordinates, hits[2]->coordinates, hits[3]->coordinates );
+	const vec3 BRDF = mat.albedo * ( 1 / PI );
+	const vector<Primitive *> &lights = scene->getLights();
+
+	// The hemisphere on the side the ray arrived from, as in indirectLight()
+	vec3 facing[4];
+	for ( int lane = 0; lane < 4; lane++ )
+	{
+		facing[lane] = hits[lane]->hitType < 0 ? -hits[lane]->normal : hits[lane]->normal;
+		result[lane] = vec3( 0.f, 0.f, 0.f );
+	}
+	const vec3x4 normals( facing[0], facing[1], facing[2], facing[3] );
+
+	for ( size_t i = 0; i < lights.size(); i++ )
+	{
+		vec3 directions[4];
+		float pdfs[4];
+		RayPacket4 packet;
+		for ( int lane = 0; lane < 4; lane++ )
+		{
+			pdfs[lane] = sampleLight<Features>( lights[i], hits[lane]->coordinates, directions[lane], packet.maxT[lane] );
+		}
+		const vec3x4 toLight = vec3x4::load( directions );
+		const __m128 pdf = _mm_loadu_ps( pdfs );
+
+		// Not greater than zero, like directLight, so NaN is still traced
+		const __m128 cos_i = dot( toLight, normals );
+		const int lit = _mm_movemask_ps( _mm_and_ps( _mm_cmpnle_ps( cos_i, _mm_setzero_ps() ), _mm_cmpgt_ps( pdf, _mm_setzero_ps() ) ) );
+		if ( lit == 0 )
+		{
+			continue;
+		}
+
+		packet.origin = coordinates + toLight * _mm_set1_ps( SHADOWBIAS );
+		packet.direction = toLight;
+
+		vec3 origins[4];
+		float weights[4];
+		packet.origin.store( origins );
+		_mm_storeu_ps( weights, _mm_div_ps( cos_i, pdf ) );
+
+		// The light matters whether it is blocked or not, and so does whatever blocks it
+		int occluders[4] = {-1, -1, -1, -1};
+		int occluded = 0, traced = 0;
+		for ( int lane = 0; lane < 4; lane++ )
+		{
+			if ( !( lit & ( 1 << lane ) ) )
+			{
+				continue;
+			}
+
+			packet.rays[lane].origin = origins[lane];
+			packet.rays[lane].direction = directions[lane];
+			signatures[lane]->add( lights[i]->id, lights[i]->mat.id );
+			stats.add( STAT_SHADOW_RAYS );
+
+#ifdef OCCLUDER_CACHE
+			if ( occludedByLast( packet.rays[lane], packet.maxT[lane], i, occluders[lane] ) )
+			{
+				occluded |= 1 << lane;
+				continue;
+			}
+#endif
+			traced |= 1 << lane;
+		}
+
+		if ( traced != 0 )
+		{
+			const int blocked = scene->getBVH().occluded4( packet, traced, lights[i]->id, occluders );
+			occluded |= blocked;
+
+#ifdef OCCLUDER_CACHE
+			for ( int lane = 0; lane < 4; lane++ )
+			{
+				if ( blocked & ( 1 << lane ) )
+				{
+					occluderCache[threadIndex() * lights.size() + i] = occluders[lane];
+				}
+			}
+#endif
+		}
+
+		for ( int lane = 0; lane < 4; lane++ )
+		{
+			if ( occluded & ( 1 << lane ) )
+			{
+				signatures[lane]->add( occluders[lane], -1 );
+			}
+			else if ( lit & ( 1 << lane ) )
+			{
+				result[lane] += BRDF * lights[i]->mat.emission * weights[lane];
+			}
+		}
+	}
+}
+#endif
+
+// Sets occluder to the id of the primitive that blocks the ray
+bool Renderer::isOccluded( const Ray &r, float distance, size_t light, int &occluder ) const
+{
+	stats.add( STAT_SHADOW_RAYS );
+
+#ifdef OCCLUDER_CACHE
+	if ( occludedByLast( r, distance, light, occluder ) )
+	{
+		return true;
+	}
+#endif
+
+	bool occluded = scene->getBVH().occluded( r, distance, scene->getLights()[light]->id, occluder );
+
+#ifdef OCCLUDER_CACHE
+	if ( occluded )
+	{
+		occluderCache[threadIndex() * scene->getLights().size() + light] = occluder;
+	}
+#endif
+
+	return occluded;
+}
+
+#ifdef OCCLUDER_CACHE
+// Shadow rays of neighbouring pixels are usually blocked by the same primitive
+bool Renderer::occludedByLast( const Ray &r, float distance, size_t light, int &occluder ) const
+{
+	const int lastOccluder = occluderCache[threadIndex() * scene->getLights().size() + light];
+	if ( lastOccluder == -1 )
+	{
+		return false;
+	}
+
+	Hit h = scene->getPrimitive( lastOccluder )->hit( r );
+	if ( h.hitType != 0 && h.t < distance )
+	{
+		stats.add( STAT_OCCLUDER_CACHE_HITS );
+		occluder = lastOccluder;
+		return true;
+	}
+
+	return false;
+}
+#endif
+
+CachedHit Renderer::cacheHit( const Hit &h ) const
+{
+	CachedHit c;
+	c.coordinates = h.coordinates;
+	c.normal = h.normal;
+	c.t = h.t;
+	c.u = h.u;
+	c.v = h.v;
+	c.hitType = h.hitType;
+	c.primitiveId = h.primitiveId;
+	c.materialId = h.hitType != 0 ? h.mat.id : -1;
+
+	return c;
+}
+
+Hit Renderer::restoreHit( const CachedHit &c ) const
+{
+	Hit h = Hit();
+	h.coordinates = c.coordinates;
+	h.normal = c.normal;
+	h.t = c.t;
+	h.u = c.u;
+	h.v = c.v;
+	h.hitType = c.hitType;
+	h.primitiveId = c.primitiveId;
+
+	if ( c.materialId != -1 )
+	{
+		h.mat = scene->getMaterials()[c.materialId];
+	}
+
+	return h;
 }
 
 Pixel Renderer::rgb( float r, float g, float b ) const
@@ -302,18 +1318,7 @@ Pixel Renderer::rgb( vec3 vec ) const
 	return rgb( vec.x, vec.y, vec.z );
 }
 
-union simdVector {
-	__m128 v;   // SSE 4 x float vector
-	float a[4]; // scalar array of 4 floats
-};
-
 vec3 Renderer::gammaCorrect( vec3 vec ) const
 {
-	__m128 val = _mm_set_ps( vec.x, vec.y, vec.z, vec.dummy );
-	__m128 corrected = _mm_sqrt_ps( val );
-
-	simdVector convert;
-	convert.v = corrected;
-	vec3 res = vec3( convert.a[3], convert.a[2], convert.a[1] );
-	return res;
+	return vec3( _mm_sqrt_ps( vec.v4 ) );
 }
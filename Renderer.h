@@ -1,4 +1,19 @@
 #pragma once
+
+// Features the tile kernel is specialized on, so those a frame does not use cost nothing per pixel
+// renderFrame() picks the instantiation that matches the scene and camera once per frame
+enum KernelFeature
+{
+	KERNEL_DOF = 1,				 // Primary rays sample the lens, off for a pinhole camera
+	KERNEL_RASTER = 2,			 // Primary hits come from the rasterizer instead of the BVH
+	KERNEL_CACHE_REPLAY = 4,	 // Primary hits are restored from the primary hit cache
+	KERNEL_CACHE_FILL = 8,		 // Primary hits are stored in the primary hit cache
+	KERNEL_SPHERE_LIGHTS = 16,	 // Every light is a Sphere, its solid angle is not a virtual call
+	KERNEL_TRIANGLE_LIGHTS = 32, // Every light is a Triangle
+	KERNEL_VARIANTS = 64,
+	KERNEL_GENERIC = KERNEL_DOF // Assumes nothing about the scene and camera
+};
+
 class Renderer
 {
   public:
@@ -15,26 +30,157 @@ class Renderer
 	void changeAperture( float deltaAperture );
 	void focusCam();
 
+	// Pixel the viewer looks at, the HUD crosshair unless set. Tiles are rendered in order of their distance to
+	// it, and with FOVEATION the tiles around it get extra samples in the first iterations after a reset
+	void setFocus( int x, int y );
+
+	// Only the tiles that intersect [x0, x1) x [y0, y1) are rendered, the other pixels keep what they accumulated
+	// An empty rectangle renders the whole frame again. getCrop is false without a crop
+	void setCrop( int x0, int y0, int x1, int y1 );
+	bool getCrop( int &x0, int &y0, int &x1, int &y1 ) const;
+
 	Pixel *getOutput() const;
 
+	// Linear radiance per pixel, the mean of the samples accumulated so far
+	void getRadiance( vec3 *radiance ) const;
+
+	// Iterations rendered since the accumulation was last reset, rendering pauses at the maximum
+	unsigned getIteration() const;
+	unsigned getMaxIterations() const;
+	void setMaxIterations( unsigned iterations );
+
+	// Makes every following frame reproducible, given the same sequence of calls
+	void setSeed( unsigned seed );
+
+	// With PRIMARY_CACHE a static pinhole view reuses PRIMARYCACHESIZE jittered primary hits, on by default
+	// Without it every iteration traces new primary rays, so the image converges past PRIMARYCACHESIZE jitters
+	void setPrimaryCache( bool enabled );
+
+	// With FOVEATION the tiles around the focus point get extra samples after a reset, on by default. They add to
+	// the frame time of those iterations, and the pixels no longer have one sample per iteration
+	void setFoveation( bool enabled );
+
+	// Tiles of the frame, tile t covers [x0, x1) x [y0, y1)
+	int getTileCount() const;
+	void getTileBounds( int tile, int &x0, int &y0, int &x1, int &y1 ) const;
+
+	// Sum of the samples iterations first up to first + count add to one tile of a seeded render, row by row
+	// Nothing rendered before changes it, so every renderer with the same scene, camera, seed and tile size
+	// returns the same sum. Always uses the tile kernel without primary hit cache and rasterizer, and leaves the
+	// accumulated image alone
+	void renderTileSamples( int tile, unsigned first, unsigned count, vec3 *sum );
+
+	// Adds count samples per pixel rendered by renderTileSamples, possibly in another process
+	void addTileSamples( int tile, unsigned count, const vec3 *sum );
+
+	// Batched ray queries against the scene, for callers outside of the renderer
+	const SceneQuery &getSceneQuery() const;
+
+	// Scene edits, rendered from the first iteration that starts after SceneManager::commit()
+	SceneManager &getSceneManager();
+
+	const Statistics &getStatistics() const;
+	size_t getLightCount();
+
   private:
 	vector<tuple<int, int>> tiles;
+	unsigned tileSize; // Of Tuning, when the renderer was created
+
+#ifdef TILE_COST_BALANCE
+	// Milliseconds per tile in the previous iteration, valid while the view and the tile kernel stay the same
+	vector<float> tileCost;
+	bool tileCostValid;
+	Camera costCam;
+	unsigned costFeatures;
+#endif
+	vector<int> runOrder; // tileOrder grouped by run, see renderTiles
+	vector<int> tileRuns; // The tiles of thread t are runOrder[tileRuns[t]] up to runOrder[tileRuns[t + 1]]
+
+	int focusX, focusY;
+	int cropX0, cropY0, cropX1, cropY1; // The whole frame without a crop
+	vector<int> tileOrder;				 // Tiles inside the crop, by distance to the focus point
+#ifdef FOVEATION
+	vector<pair<int, unsigned>> foveaTiles; // Tile and number of extra samples, nearest tiles first
+#endif
+	void updateTileOrder();
 
 	Camera cam;
-	vector<Primitive *> primitives;
-	const BVH bvh;
-	// vector<Light *> lights;
+	SceneManager scenes;
+	const Scene *scene; // Snapshot pinned during renderFrame()
+	unsigned sceneVersion;
+	SceneQuery sceneQuery;
+	Rasterizer rasterizer;
+
+	mutable Statistics stats;
+
+	// Last occluder found per thread and light, MAXTHREADS * light count primitive ids
+	mutable vector<int> occluderCache;
+
+	unsigned currentIteration; // Iterations since the last reset of any pixel
+	unsigned maxIterations;
+
+	bool seeded;
+	unsigned seed;
+	unsigned frameIndex; // Rendered frames since setSeed()
 
-	unsigned currentIteration;
 	vec3 *prebuffer;
+	unsigned *sampleCount;		// Samples accumulated per pixel
+	PathSignature *signatures; // Everything the accumulated samples of a pixel depend on
 	Pixel *buffer;
 	bool *boolbuffer; // TEST
 
+	// Primary hit cache, PRIMARYCACHESIZE entries per pixel
+	CachedHit *primaryCache;
+	Camera cacheCam;
+	unsigned cacheIteration;
+	bool primaryCacheEnabled;
+	bool foveationEnabled;
+
+	// KERNEL_SPHERE_LIGHTS and KERNEL_TRIANGLE_LIGHTS of the current snapshot, both without lights
+	unsigned emitterFeatures;
+
+	typedef void ( Renderer::*TileKernel )( int tile, unsigned slot, unsigned pass );
+	static TileKernel selectKernel( unsigned features );
+	void renderTiles( TileKernel kernel, unsigned features, unsigned slot );
+	template <size_t... Features>
+	static TileKernel selectKernel( unsigned features, index_sequence<Features...> );
+
+	// Renders one sample of every pixel of a tile, slot is the primary cache entry of this iteration
+	// Pass 0 is the sample of the iteration, later passes are the extra samples of foveation
+	template <unsigned Features>
+	void renderTile( int tile, unsigned slot, unsigned pass );
+
+	template <unsigned Features>
+	Ray primaryRay( unsigned x, unsigned y ) const;
 	vec3 shootRay( unsigned x, unsigned y, unsigned depth ) const;
 	vec3 shootRay( const Ray &r, unsigned depth ) const;
+	template <unsigned Features>
+	vec3 shade( const Hit &closestHit, unsigned depth, PathSignature &signature ) const;
+	template <unsigned Features>
+	vec3 directLight( const Hit &closestHit, PathSignature &signature ) const;
+	template <unsigned Features>
+	vec3 indirectLight( const Hit &closestHit, unsigned depth, PathSignature &signature ) const;
+	bool isOccluded( const Ray &r, float distance, size_t light, int &occluder ) const;
+#ifdef OCCLUDER_CACHE
+	bool occludedByLast( const Ray &r, float distance, size_t light, int &occluder ) const;
+#endif
+#ifdef SORT_BY_MATERIAL
+	template <unsigned Features>
+	void shadeSorted( unsigned count );
+	template <unsigned Features>
+	void directLight4( const CachedHit *const *hits, const Material &mat, PathSignature *const *signatures, vec3 *result ) const;
+#endif
+
+	void sceneChanged();
+	bool resetChangedPixels();
+	CachedHit cacheHit( const Hit &h ) const;
+	Hit restoreHit( const CachedHit &c ) const;
 
 	void invalidatePrebuffer();
 
+	// Per pixel buffers allocated by the constructor
+	static size_t framebufferBytes();
+
 	// rgb to Pixel
 	Pixel rgb( float r, float g, float b ) const;
 	Pixel rgb( vec3 vec ) const;
@@ -0,0 +1,186 @@
+#pragma once
+
+// Structure of arrays vectors for kernels that process a batch of pixels, rays or primitives at once:
+// lane i of x, y and z together is the i-th vec3 of the batch.
+// vec3x4 is four vectors in SSE registers. vec3x8 is eight, in AVX registers when compiled with AVX
+// and in two vec3x4 otherwise, so a kernel can be written eight wide either way.
+
+// Eight floats, the scalar lanes of a vec3x8
+struct float8
+{
+#ifdef __AVX__
+	__m256 v;
+
+	float8() = default;
+	float8( const __m256 v ) : v( v ) {}
+	float8( float s ) : v( _mm256_set1_ps( s ) ) {}
+
+	static float8 load( const float *f ) { return float8( _mm256_loadu_ps( f ) ); }
+	void store( float *f ) const { _mm256_storeu_ps( f, v ); }
+
+	float8 operator + ( const float8 &o ) const { return float8( _mm256_add_ps( v, o.v ) ); }
+	float8 operator - ( const float8 &o ) const { return float8( _mm256_sub_ps( v, o.v ) ); }
+	float8 operator * ( const float8 &o ) const { return float8( _mm256_mul_ps( v, o.v ) ); }
+#else
+	__m128 lo, hi;
+
+	float8() = default;
+	float8( const __m128 lo, const __m128 hi ) : lo( lo ), hi( hi ) {}
+	float8( float s ) : lo( _mm_set1_ps( s ) ), hi( _mm_set1_ps( s ) ) {}
+
+	static float8 load( const float *f ) { return float8( _mm_loadu_ps( f ), _mm_loadu_ps( f + 4 ) ); }
+	void store( float *f ) const { _mm_storeu_ps( f, lo ), _mm_storeu_ps( f + 4, hi ); }
+
+	float8 operator + ( const float8 &o ) const { return float8( _mm_add_ps( lo, o.lo ), _mm_add_ps( hi, o.hi ) ); }
+	float8 operator - ( const float8 &o ) const { return float8( _mm_sub_ps( lo, o.lo ), _mm_sub_ps( hi, o.hi ) ); }
+	float8 operator * ( const float8 &o ) const { return float8( _mm_mul_ps( lo, o.lo ), _mm_mul_ps( hi, o.hi ) ); }
+#endif
+};
+
+struct vec3x4
+{
+	__m128 x, y, z;
+
+	vec3x4() = default;
+	vec3x4( const __m128 x, const __m128 y, const __m128 z ) : x( x ), y( y ), z( z ) {}
+	// The same vector in every lane
+	explicit vec3x4( const vec3 &v ) : x( _mm_set1_ps( v.x ) ), y( _mm_set1_ps( v.y ) ), z( _mm_set1_ps( v.z ) ) {}
+	// Four vectors that are not consecutive in memory
+	vec3x4( const vec3 &a, const vec3 &b, const vec3 &c, const vec3 &d )
+	{
+		__m128 r0 = a.v4, r1 = b.v4, r2 = c.v4, r3 = d.v4;
+		_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+		x = r0, y = r1, z = r2;
+	}
+
+	// Four consecutive vectors, transposed into lanes
+	static vec3x4 load( const vec3 *v )
+	{
+		__m128 r0 = v[0].v4, r1 = v[1].v4, r2 = v[2].v4, r3 = v[3].v4;
+		_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+		return vec3x4( r0, r1, r2 );
+	}
+
+	void store( vec3 *v ) const
+	{
+		__m128 r0 = x, r1 = y, r2 = z, r3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+		v[0].v4 = r0, v[1].v4 = r1, v[2].v4 = r2, v[3].v4 = r3;
+	}
+
+	vec3x4 operator + ( const vec3x4 &o ) const { return vec3x4( _mm_add_ps( x, o.x ), _mm_add_ps( y, o.y ), _mm_add_ps( z, o.z ) ); }
+	vec3x4 operator - ( const vec3x4 &o ) const { return vec3x4( _mm_sub_ps( x, o.x ), _mm_sub_ps( y, o.y ), _mm_sub_ps( z, o.z ) ); }
+	vec3x4 operator * ( const vec3x4 &o ) const { return vec3x4( _mm_mul_ps( x, o.x ), _mm_mul_ps( y, o.y ), _mm_mul_ps( z, o.z ) ); }
+	vec3x4 operator * ( const __m128 s ) const { return vec3x4( _mm_mul_ps( x, s ), _mm_mul_ps( y, s ), _mm_mul_ps( z, s ) ); }
+};
+
+inline __m128 dot( const vec3x4 &a, const vec3x4 &b )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( a.x, b.x ), _mm_mul_ps( a.y, b.y ) ), _mm_mul_ps( a.z, b.z ) );
+}
+
+inline vec3x4 cross( const vec3x4 &a, const vec3x4 &b )
+{
+	return vec3x4( _mm_sub_ps( _mm_mul_ps( a.y, b.z ), _mm_mul_ps( a.z, b.y ) ),
+				   _mm_sub_ps( _mm_mul_ps( a.z, b.x ), _mm_mul_ps( a.x, b.z ) ),
+				   _mm_sub_ps( _mm_mul_ps( a.x, b.y ), _mm_mul_ps( a.y, b.x ) ) );
+}
+
+inline vec3x4 sqrt( const vec3x4 &v ) { return vec3x4( _mm_sqrt_ps( v.x ), _mm_sqrt_ps( v.y ), _mm_sqrt_ps( v.z ) ); }
+
+// Per component clamp to [0, 1], NaN becomes 0
+inline vec3x4 saturate( const vec3x4 &v )
+{
+	const __m128 l = _mm_setzero_ps(), h = _mm_set1_ps( 1.f );
+	return vec3x4( _mm_min_ps( _mm_max_ps( v.x, l ), h ), _mm_min_ps( _mm_max_ps( v.y, l ), h ), _mm_min_ps( _mm_max_ps( v.z, l ), h ) );
+}
+
+// Components in [0, 1] to 0xAARRGGBB pixels with full alpha, truncating like Renderer::rgb
+inline void packPixels( const vec3x4 &v, Pixel *out )
+{
+	const __m128 scale = _mm_set1_ps( 255.f );
+	const __m128i r = _mm_cvttps_epi32( _mm_mul_ps( v.x, scale ) );
+	const __m128i g = _mm_cvttps_epi32( _mm_mul_ps( v.y, scale ) );
+	const __m128i b = _mm_cvttps_epi32( _mm_mul_ps( v.z, scale ) );
+	const __m128i argb = _mm_or_si128( _mm_or_si128( _mm_set1_epi32( (int)0xff000000 ), _mm_slli_epi32( r, 16 ) ), _mm_or_si128( _mm_slli_epi32( g, 8 ), b ) );
+	_mm_storeu_si128( (__m128i *)out, argb );
+}
+
+struct vec3x8
+{
+#ifdef __AVX__
+	__m256 x, y, z;
+
+	vec3x8() = default;
+	vec3x8( const __m256 x, const __m256 y, const __m256 z ) : x( x ), y( y ), z( z ) {}
+	explicit vec3x8( const vec3 &v ) : x( _mm256_set1_ps( v.x ) ), y( _mm256_set1_ps( v.y ) ), z( _mm256_set1_ps( v.z ) ) {}
+
+	vec3x4 lower() const { return vec3x4( _mm256_castps256_ps128( x ), _mm256_castps256_ps128( y ), _mm256_castps256_ps128( z ) ); }
+	vec3x4 upper() const { return vec3x4( _mm256_extractf128_ps( x, 1 ), _mm256_extractf128_ps( y, 1 ), _mm256_extractf128_ps( z, 1 ) ); }
+
+	static vec3x8 load( const vec3 *v )
+	{
+		const vec3x4 lo = vec3x4::load( v ), hi = vec3x4::load( v + 4 );
+		return vec3x8( _mm256_insertf128_ps( _mm256_castps128_ps256( lo.x ), hi.x, 1 ),
+					   _mm256_insertf128_ps( _mm256_castps128_ps256( lo.y ), hi.y, 1 ),
+					   _mm256_insertf128_ps( _mm256_castps128_ps256( lo.z ), hi.z, 1 ) );
+	}
+
+	void store( vec3 *v ) const { lower().store( v ), upper().store( v + 4 ); }
+
+	vec3x8 operator + ( const vec3x8 &o ) const { return vec3x8( _mm256_add_ps( x, o.x ), _mm256_add_ps( y, o.y ), _mm256_add_ps( z, o.z ) ); }
+	vec3x8 operator - ( const vec3x8 &o ) const { return vec3x8( _mm256_sub_ps( x, o.x ), _mm256_sub_ps( y, o.y ), _mm256_sub_ps( z, o.z ) ); }
+	vec3x8 operator * ( const vec3x8 &o ) const { return vec3x8( _mm256_mul_ps( x, o.x ), _mm256_mul_ps( y, o.y ), _mm256_mul_ps( z, o.z ) ); }
+	vec3x8 operator * ( const float8 &s ) const { return vec3x8( _mm256_mul_ps( x, s.v ), _mm256_mul_ps( y, s.v ), _mm256_mul_ps( z, s.v ) ); }
+#else
+	vec3x4 lo, hi;
+
+	vec3x8() = default;
+	vec3x8( const vec3x4 &lo, const vec3x4 &hi ) : lo( lo ), hi( hi ) {}
+	explicit vec3x8( const vec3 &v ) : lo( v ), hi( v ) {}
+
+	vec3x4 lower() const { return lo; }
+	vec3x4 upper() const { return hi; }
+
+	static vec3x8 load( const vec3 *v ) { return vec3x8( vec3x4::load( v ), vec3x4::load( v + 4 ) ); }
+	void store( vec3 *v ) const { lo.store( v ), hi.store( v + 4 ); }
+
+	vec3x8 operator + ( const vec3x8 &o ) const { return vec3x8( lo + o.lo, hi + o.hi ); }
+	vec3x8 operator - ( const vec3x8 &o ) const { return vec3x8( lo - o.lo, hi - o.hi ); }
+	vec3x8 operator * ( const vec3x8 &o ) const { return vec3x8( lo * o.lo, hi * o.hi ); }
+	vec3x8 operator * ( const float8 &s ) const { return vec3x8( lo * s.lo, hi * s.hi ); }
+#endif
+};
+
+#ifdef __AVX__
+inline float8 dot( const vec3x8 &a, const vec3x8 &b )
+{
+	return float8( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( a.x, b.x ), _mm256_mul_ps( a.y, b.y ) ), _mm256_mul_ps( a.z, b.z ) ) );
+}
+
+inline vec3x8 cross( const vec3x8 &a, const vec3x8 &b )
+{
+	return vec3x8( _mm256_sub_ps( _mm256_mul_ps( a.y, b.z ), _mm256_mul_ps( a.z, b.y ) ),
+				   _mm256_sub_ps( _mm256_mul_ps( a.z, b.x ), _mm256_mul_ps( a.x, b.z ) ),
+				   _mm256_sub_ps( _mm256_mul_ps( a.x, b.y ), _mm256_mul_ps( a.y, b.x ) ) );
+}
+
+inline vec3x8 sqrt( const vec3x8 &v ) { return vec3x8( _mm256_sqrt_ps( v.x ), _mm256_sqrt_ps( v.y ), _mm256_sqrt_ps( v.z ) ); }
+
+inline vec3x8 saturate( const vec3x8 &v )
+{
+	const __m256 l = _mm256_setzero_ps(), h = _mm256_set1_ps( 1.f );
+	return vec3x8( _mm256_min_ps( _mm256_max_ps( v.x, l ), h ), _mm256_min_ps( _mm256_max_ps( v.y, l ), h ), _mm256_min_ps( _mm256_max_ps( v.z, l ), h ) );
+}
+#else
+inline float8 dot( const vec3x8 &a, const vec3x8 &b ) { return float8( dot( a.lo, b.lo ), dot( a.hi, b.hi ) ); }
+inline vec3x8 cross( const vec3x8 &a, const vec3x8 &b ) { return vec3x8( cross( a.lo, b.lo ), cross( a.hi, b.hi ) ); }
+inline vec3x8 sqrt( const vec3x8 &v ) { return vec3x8( sqrt( v.lo ), sqrt( v.hi ) ); }
+inline vec3x8 saturate( const vec3x8 &v ) { return vec3x8( saturate( v.lo ), saturate( v.hi ) ); }
+#endif
+
+inline void packPixels( const vec3x8 &v, Pixel *out )
+{
+	packPixels( v.lower(), out );
+	packPixels( v.upper(), out + 4 );
+}
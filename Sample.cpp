@@ -7,8 +7,11 @@ vec3 Sample::cosineSampleHemisphere( const float &u1, const float &u2 )
 	const float r = sqrt( u1 );
 	const float theta = 2 * PI * u2;
 
-	const float x = r * cos( theta );
-	const float y = r * sin( theta );
+	float sinTheta, cosTheta;
+	fastSinCos( theta, sinTheta, cosTheta );
+
+	const float x = r * cosTheta;
+	const float y = r * sinTheta;
 
 	return vec3( x, y, sqrt( std::max( 0.f, 1 - u1 ) ) );
 }
@@ -20,7 +23,9 @@ vec3 Sample::uniformSampleHemisphere( const float &r1, const float &r2 )
 	// cos^2(theta) + sin^2(theta) = 1 -> sin(theta) = srtf(1 - cos^2(theta))
 	float sinTheta = sqrtf( 1 - r1 * r1 );
 	float phi = 2 * M_PI * r2;
-	float x = sinTheta * cosf( phi );
-	float z = sinTheta * sinf( phi );
+	float sinPhi, cosPhi;
+	fastSinCos( phi, sinPhi, cosPhi );
+	float x = sinTheta * cosPhi;
+	float z = sinTheta * sinPhi;
 	return vec3( x, r1, z );
 }
\ No newline at end of file
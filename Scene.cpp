@@ -0,0 +1,439 @@
+#include "precomp.h"
+
+static vector<Primitive *> livePrimitives( const vector<shared_ptr<Primitive>> &primitives )
+{
+	vector<Primitive *> result;
+	for ( const shared_ptr<Primitive> &p : primitives )
+	{
+		if ( p )
+		{
+			result.push_back( p.get() );
+		}
+	}
+	return result;
+}
+
+Scene::Scene( const vector<shared_ptr<Primitive>> &primitives, const vector<Material> &materials, const vector<shared_ptr<const Texture>> &textures, const vector<SceneChange> &history, const BVH &bvh, unsigned version ) : owned( primitives ), live( livePrimitives( primitives ) ), materials( materials ), textures( textures ), history( history ), version( version ), bvh( bvh )
+{
+	byId.resize( owned.size() );
+	for ( size_t i = 0; i < owned.size(); i++ )
+	{
+		byId[i] = owned[i].get();
+	}
+
+	for ( Primitive *p : live )
+	{
+		if ( p->mat.type == EMIT_MAT )
+		{
+			lights.push_back( p );
+		}
+	}
+
+	memoryTracker.allocate( MEM_SCENE, sceneBytes() );
+	memoryTracker.allocate( MEM_MATERIALS, this->materials.capacity() * sizeof( Material ) );
+}
+
+Scene::~Scene()
+{
+	memoryTracker.release( MEM_SCENE, sceneBytes() );
+	memoryTracker.release( MEM_MATERIALS, materials.capacity() * sizeof( Material ) );
+}
+
+// The primitives themselves are shared between snapshots and counted on their own
+size_t Scene::sceneBytes() const
+{
+	return sizeof( Scene ) + owned.capacity() * sizeof( shared_ptr<Primitive> ) + ( byId.capacity() + live.capacity() + lights.capacity() ) * sizeof( Primitive * ) +
+		   history.capacity() * sizeof( SceneChange );
+}
+
+bool Scene::changesSince( unsigned since, vector<SceneChange> &changes ) const
+{
+	// Versions before the oldest one in the history are unknown
+	if ( since + 1 < version && ( history.empty() || history.front().version > since + 1 ) )
+	{
+		return false;
+	}
+
+	for ( const SceneChange &c : history )
+	{
+		if ( c.version > since )
+		{
+			changes.push_back( c );
+		}
+	}
+
+	return true;
+}
+
+SceneManager::SceneManager( const vector<Primitive *> &primitives, const vector<Texture *> &textures ) : epoch( 1 ), bvh( primitives ), version( 0 )
+{
+	for ( int i = 0; i < MAXTHREADS; i++ )
+	{
+		readerEpochs[i].store( 0 );
+	}
+
+	for ( Primitive *p : primitives )
+	{
+		p->id = (int)working.size();
+		assignMaterial( p );
+		working.push_back( shared_ptr<Primitive>( p ) );
+	}
+
+	for ( Texture *t : textures )
+	{
+		this->textures.push_back( shared_ptr<const Texture>( t ) );
+	}
+	releaseUnusedTextures();
+
+	current.store( new Scene( working, materialTable, this->textures, history, bvh, version ) );
+}
+
+SceneManager::~SceneManager()
+{
+	for ( RetiredScene &r : retired )
+	{
+		delete r.scene;
+	}
+
+	delete current.load();
+}
+
+static atomic<bool> readerSlotTaken[MAXTHREADS];
+
+// Threads that read at the same time hold different slots. A thread claims a free slot on its first acquire()
+// and gives it back when it exits, so readers that come and go, such as thread pools, never share one
+struct SceneManager::ReaderSlot
+{
+	int index = -1;
+	vector<pair<const SceneManager *, int>> depth; // Nesting of acquire() per manager, only while pinned
+
+	ReaderSlot()
+	{
+		for ( int i = 0; i < MAXTHREADS && index < 0; i++ )
+		{
+			bool expected = false;
+			if ( readerSlotTaken[i].compare_exchange_strong( expected, true ) )
+			{
+				index = i;
+			}
+		}
+
+		if ( index < 0 )
+		{
+			fprintf( stderr, "SceneManager: more than %d threads read a scene at the same time\n", MAXTHREADS );
+			abort();
+		}
+	}
+
+	~ReaderSlot()
+	{
+		readerSlotTaken[index].store( false );
+	}
+
+	// True for the outermost acquire() of the manager
+	bool enter( const SceneManager *manager )
+	{
+		for ( pair<const SceneManager *, int> &d : depth )
+		{
+			if ( d.first == manager )
+			{
+				d.second++;
+				return false;
+			}
+		}
+		depth.push_back( make_pair( manager, 1 ) );
+		return true;
+	}
+
+	// True for the outermost release() of the manager
+	bool leave( const SceneManager *manager )
+	{
+		for ( size_t i = 0; i < depth.size(); i++ )
+		{
+			if ( depth[i].first == manager && --depth[i].second == 0 )
+			{
+				depth[i] = depth.back();
+				depth.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+SceneManager::ReaderSlot &SceneManager::readerSlot()
+{
+	thread_local ReaderSlot slot;
+	return slot;
+}
+
+const Scene *SceneManager::acquire()
+{
+	ReaderSlot &reader = readerSlot();
+
+	// Announce the epoch before loading the snapshot, so a writer can not reclaim what we load
+	if ( reader.enter( this ) )
+	{
+		readerEpochs[reader.index].store( epoch.load() );
+	}
+
+	return current.load();
+}
+
+void SceneManager::release()
+{
+	ReaderSlot &reader = readerSlot();
+
+	if ( reader.leave( this ) )
+	{
+		readerEpochs[reader.index].store( 0 );
+	}
+}
+
+int SceneManager::addPrimitive( Primitive *primitive )
+{
+	lock_guard<mutex> lock( editLock );
+
+	primitive->id = (int)working.size();
+	assignMaterial( primitive );
+	working.push_back( shared_ptr<Primitive>( primitive ) );
+	bvh.insert( primitive );
+	recordChange( primitive->id, primitive->mat.id, true );
+
+	return primitive->id;
+}
+
+void SceneManager::removePrimitive( int id )
+{
+	lock_guard<mutex> lock( editLock );
+
+	if ( id >= 0 && id < (int)working.size() && working[id] )
+	{
+		// Only pixels whose paths touched the primitive, as surface or as occluder, can change
+		recordChange( id, -1, false );
+		bvh.remove( working[id].get() );
+		working[id].reset();
+	}
+}
+
+// Lights are sampled by every pixel, so a light that appears, goes away or changes its emission is a change
+// to the whole image rather than to the pixels whose paths touched it
+static bool changesLights( const Material &before, const Material &after )
+{
+	if ( ( before.type == EMIT_MAT ) != ( after.type == EMIT_MAT ) )
+	{
+		return true;
+	}
+	return after.type == EMIT_MAT && ( before.emission.x != after.emission.x || before.emission.y != after.emission.y || before.emission.z != after.emission.z );
+}
+
+void SceneManager::setMaterial( int id, const Material &mat )
+{
+	lock_guard<mutex> lock( editLock );
+
+	if ( id < 0 || id >= (int)working.size() || !working[id] )
+	{
+		return;
+	}
+
+	// Published primitives are never modified, replace it by a copy
+	const bool lights = changesLights( working[id]->mat, mat );
+	Primitive *copy = working[id]->clone();
+	copy->mat = mat;
+	assignMaterial( copy );
+	bvh.replace( working[id].get(), copy );
+	working[id].reset( copy );
+
+	recordChange( id, -1, lights );
+}
+
+void SceneManager::updateMaterial( int materialId, const Material &mat )
+{
+	lock_guard<mutex> lock( editLock );
+
+	if ( materialId < 0 || materialId >= (int)materialTable.size() )
+	{
+		return;
+	}
+
+	const bool lights = changesLights( materialTable[materialId], mat );
+	materialTable[materialId] = mat;
+	materialTable[materialId].id = materialId;
+
+	for ( shared_ptr<Primitive> &p : working )
+	{
+		if ( p && p->mat.id == materialId )
+		{
+			Primitive *copy = p->clone();
+			copy->mat = materialTable[materialId];
+			bvh.replace( p.get(), copy );
+			p.reset( copy );
+		}
+	}
+
+	recordChange( -1, materialId, lights );
+}
+
+void SceneManager::transformPrimitive( int id, const mat4 &transform )
+{
+	lock_guard<mutex> lock( editLock );
+
+	if ( id < 0 || id >= (int)working.size() || !working[id] )
+	{
+		return;
+	}
+
+	// Published primitives are never modified, replace it by a copy
+	Primitive *copy = working[id]->clone();
+	copy->transform( transform );
+	bvh.remove( working[id].get() );
+	bvh.insert( copy );
+	working[id].reset( copy );
+
+	recordChange( id, -1, true );
+}
+
+void SceneManager::commit()
+{
+	lock_guard<mutex> lock( editLock );
+
+	version++;
+
+	// Keep the changes of the last CHANGEHISTORY versions
+	for ( SceneChange &c : pending )
+	{
+		c.version = version;
+		history.push_back( c );
+	}
+	pending.clear();
+
+	size_t keep = 0;
+	while ( keep < history.size() && history[keep].version + CHANGEHISTORY <= version )
+	{
+		keep++;
+	}
+	history.erase( history.begin(), history.begin() + keep );
+
+	releaseUnusedTextures();
+
+	Scene *next = new Scene( working, materialTable, textures, history, bvh, version );
+	Scene *previous = current.exchange( next );
+
+	// Readers that announced this epoch or an earlier one may still see the previous snapshot
+	RetiredScene r;
+	r.scene = previous;
+	r.epoch = epoch.fetch_add( 1 );
+	retired.push_back( r );
+
+	collect();
+}
+
+void SceneManager::reclaim()
+{
+	// Never wait for a writer, the next commit or reclaim will clean up instead
+	unique_lock<mutex> lock( editLock, try_to_lock );
+
+	if ( lock.owns_lock() )
+	{
+		collect();
+	}
+}
+
+void SceneManager::collect()
+{
+	uint64 oldest = UINT64_MAX;
+	for ( int i = 0; i < MAXTHREADS; i++ )
+	{
+		uint64 e = readerEpochs[i].load();
+		if ( e != 0 )
+		{
+			oldest = min( oldest, e );
+		}
+	}
+
+	for ( size_t i = 0; i < retired.size(); )
+	{
+		if ( retired[i].epoch < oldest )
+		{
+			delete retired[i].scene;
+			retired[i] = retired.back();
+			retired.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void SceneManager::recordChange( int primitiveId, int materialId, bool geometry )
+{
+	SceneChange c;
+	c.version = 0; // Assigned by commit()
+	c.primitiveId = primitiveId;
+	c.materialId = materialId;
+	c.geometry = geometry;
+	pending.push_back( c );
+}
+
+const Texture *SceneManager::addTexture( Texture *texture )
+{
+	lock_guard<mutex> lock( editLock );
+
+	textures.push_back( shared_ptr<const Texture>( texture ) );
+	return texture;
+}
+
+// A texture goes with the last primitive whose material uses it. Snapshots that still show such a primitive
+// hold their own reference, so it is freed once they are reclaimed
+void SceneManager::releaseUnusedTextures()
+{
+	vector<const Texture *> used;
+	for ( const shared_ptr<Primitive> &p : working )
+	{
+		if ( p && p->mat.hasDiffuse() )
+		{
+			used.push_back( p->mat.getTexture() );
+		}
+	}
+	sort( used.begin(), used.end() );
+
+	for ( size_t i = 0; i < textures.size(); )
+	{
+		const Texture *t = textures[i].get();
+		if ( binary_search( used.begin(), used.end(), t ) )
+		{
+			i++;
+			continue;
+		}
+
+		// No primitive has these materials anymore, so they can drop the texture without changing any pixel
+		for ( Material &m : materialTable )
+		{
+			if ( m.getTexture() == t )
+			{
+				m.setDiffuse( nullptr );
+			}
+		}
+
+		textures[i] = textures.back();
+		textures.pop_back();
+	}
+}
+
+// Materials that only differ in their id share one entry of the material table
+int SceneManager::assignMaterial( Primitive *primitive )
+{
+	for ( size_t m = 0; m < materialTable.size(); m++ )
+	{
+		if ( materialTable[m].sameAs( primitive->mat ) )
+		{
+			primitive->mat.id = (int)m;
+			return primitive->mat.id;
+		}
+	}
+
+	primitive->mat.id = (int)materialTable.size();
+	materialTable.push_back( primitive->mat );
+	return primitive->mat.id;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// One edit, as recorded in the change history of the snapshots
+struct SceneChange
+{
+	unsigned version; // Snapshot that introduced the change
+	int primitiveId;  // Primitive whose appearance changed, -1 if none
+	int materialId;	  // Material whose appearance changed, -1 if none
+	bool geometry;	  // Added or moved geometry, or changed lights, which can show up in any pixel
+};
+
+// Immutable snapshot of the scene, as seen by the render threads during one iteration
+// Primitives are shared between snapshots, edits replace them with modified copies
+class Scene
+{
+  public:
+	Scene( const vector<shared_ptr<Primitive>> &primitives, const vector<Material> &materials, const vector<shared_ptr<const Texture>> &textures, const vector<SceneChange> &history, const BVH &bvh, unsigned version );
+	~Scene();
+	Scene( const Scene & ) = delete;
+
+	// Indexed by primitive id, nullptr for removed primitives
+	const vector<Primitive *> &getPrimitives() const { return byId; }
+	Primitive *getPrimitive( int id ) const { return byId[id]; }
+
+	// Indexed by material id
+	const vector<Material> &getMaterials() const { return materials; }
+
+	// Emissive primitives
+	const vector<Primitive *> &getLights() const { return lights; }
+
+	const BVH &getBVH() const { return bvh; }
+	unsigned getVersion() const { return version; }
+	size_t getPrimitiveCount() const { return live.size(); }
+
+	// All changes made after snapshot 'since', false when the history does not go back that far
+	bool changesSince( unsigned since, vector<SceneChange> &changes ) const;
+
+  private:
+	vector<shared_ptr<Primitive>> owned;
+	vector<Primitive *> byId;
+	vector<Primitive *> live;
+	vector<Material> materials;
+	vector<shared_ptr<const Texture>> textures; // Those the materials point to, kept alive as long as the snapshot
+	vector<Primitive *> lights;
+	vector<SceneChange> history; // Changes of the last CHANGEHISTORY versions
+	unsigned version;
+	const BVH bvh;
+
+	size_t sceneBytes() const;
+};
+
+// Publishes scene snapshots to the render threads (read-copy-update)
+// Readers pin the current snapshot with acquire() / release() and never wait.
+// Edits are collected until commit(), which swaps in a new snapshot. Replaced snapshots are reclaimed
+// once every reader that could still see them has released it (epoch based reclamation).
+class SceneManager
+{
+  public:
+	// Takes ownership of the primitives and of the textures their materials use
+	SceneManager( const vector<Primitive *> &primitives, const vector<Texture *> &textures = vector<Texture *>() );
+	~SceneManager();
+
+	// Pin the current snapshot for the calling thread, can be nested
+	// At most MAXTHREADS threads may hold a snapshot at the same time, any number of threads may do so over time
+	const Scene *acquire();
+	void release();
+
+	// Edits, visible to readers after commit()
+	// Primitive ids stay valid until the primitive is removed, and are never reused
+	int addPrimitive( Primitive *primitive );
+	void removePrimitive( int id );
+	void setMaterial( int id, const Material &mat );
+	void updateMaterial( int materialId, const Material &mat ); // Every primitive using the material
+	void transformPrimitive( int id, const mat4 &transform );
+	void commit();
+
+	// Takes ownership of a texture for Material::setDiffuse. The first commit() after which no primitive uses
+	// it releases it, so give it to a primitive before committing
+	const Texture *addTexture( Texture *texture );
+
+	// Free replaced snapshots that no reader can see anymore, skipped while a writer is busy
+	void reclaim();
+
+  private:
+	// Snapshot readers
+	atomic<Scene *> current;
+	atomic<uint64> epoch;
+	atomic<uint64> readerEpochs[MAXTHREADS]; // By reader slot, 0 when the thread owning the slot is not reading
+
+	// Snapshot writers, serialized by editLock
+	mutex editLock;
+	vector<shared_ptr<Primitive>> working;		// Indexed by primitive id
+	BVH bvh;									// Of working, updated incrementally and shared with the snapshots
+	vector<Material> materialTable;				// Never shrinks, so material ids stay valid
+	vector<shared_ptr<const Texture>> textures;	// Used by the working primitives, shared with the snapshots
+	vector<SceneChange> history;				// Committed changes, see CHANGEHISTORY
+	vector<SceneChange> pending;				// Changes of the next commit
+	unsigned version;
+
+	struct RetiredScene
+	{
+		Scene *scene;
+		uint64 epoch;
+	};
+	vector<RetiredScene> retired;
+
+	struct ReaderSlot;
+	static ReaderSlot &readerSlot();
+	int assignMaterial( Primitive *primitive );
+	void recordChange( int primitiveId, int materialId, bool geometry );
+	void releaseUnusedTextures();
+	void collect();
+};
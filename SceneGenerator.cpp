@@ -0,0 +1,207 @@
+#include "precomp.h"
+
+static Triangle *makeTriangle( const vec3 &a, const vec3 &b, const vec3 &c, const Material &mat )
+{
+	vec3 verteces[3] = {a, b, c};
+	vec2 uv[3] = {vec2( 0.f, 0.f ), vec2( 1.f, 0.f ), vec2( 0.f, 1.f )};
+	return new Triangle( mat, verteces, uv );
+}
+
+const char *stressSceneName( StressScene type )
+{
+	switch ( type )
+	{
+	case SPHERE_FIELD:
+		return "sphere_field";
+	case TESSELLATED_SPHERE:
+		return "tessellated_sphere";
+	case TERRAIN:
+		return "terrain";
+	case MESH_GRID:
+		return "mesh_grid";
+	case DEGENERATE:
+		return "degenerate";
+	default:
+		return "unknown";
+	}
+}
+
+vector<Primitive *> generateStressScene( StressScene type, size_t count, unsigned seed, const Material &mat )
+{
+	switch ( type )
+	{
+	case SPHERE_FIELD:
+		return generateSphereField( count, seed, mat );
+	case TESSELLATED_SPHERE:
+		return generateTessellatedSphere( count, vec3( 0.f, 0.f, 0.f ), 1.f, mat );
+	case TERRAIN:
+		return generateTerrain( count, seed, mat );
+	case MESH_GRID:
+		return generateMeshGrid( count, mat );
+	case DEGENERATE:
+		return generateDegenerate( count, seed, mat );
+	default:
+		return vector<Primitive *>();
+	}
+}
+
+// About one sphere per 8 cubic units, however many there are
+vector<Primitive *> generateSphereField( size_t count, unsigned seed, const Material &mat )
+{
+	mt19937 rng( seed );
+	uniform_real_distribution<float> uniform( 0.f, 1.f );
+
+	const float side = 2.f * cbrtf( float( count ) );
+	vector<Primitive *> result;
+	result.reserve( count );
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		vec3 center = vec3( uniform( rng ), uniform( rng ), uniform( rng ) ) * side - vec3( 0.5f * side, 0.5f * side, 0.5f * side );
+		result.push_back( new Sphere( center, 0.1f + 0.4f * uniform( rng ), mat ) );
+	}
+
+	return result;
+}
+
+// Latitude / longitude tessellation, two triangles per quad
+vector<Primitive *> generateTessellatedSphere( size_t count, const vec3 &center, float radius, const Material &mat )
+{
+	const int segments = max( 4, (int)sqrtf( float( count ) ) );
+	const int rings = max( 2, segments / 2 );
+
+	auto point = [&]( int ring, int segment ) {
+		float theta = PI * float( ring ) / float( rings );
+		float phi = 2.f * PI * float( segment ) / float( segments );
+		return center + vec3( sinf( theta ) * cosf( phi ), cosf( theta ), sinf( theta ) * sinf( phi ) ) * radius;
+	};
+
+	vector<Primitive *> result;
+	result.reserve( 2 * rings * segments );
+
+	for ( int ring = 0; ring < rings; ring++ )
+	{
+		for ( int segment = 0; segment < segments; segment++ )
+		{
+			vec3 a = point( ring, segment ), b = point( ring, segment + 1 );
+			vec3 c = point( ring + 1, segment ), d = point( ring + 1, segment + 1 );
+
+			// The quads at the poles collapse into a single triangle
+			if ( ring > 0 )
+			{
+				result.push_back( makeTriangle( a, b, d, mat ) );
+			}
+			if ( ring < rings - 1 )
+			{
+				result.push_back( makeTriangle( a, d, c, mat ) );
+			}
+		}
+	}
+
+	return result;
+}
+
+// A 100 x 100 unit height field in the xz plane
+vector<Primitive *> generateTerrain( size_t count, unsigned seed, const Material &mat )
+{
+	mt19937 rng( seed );
+	uniform_real_distribution<float> uniform( 0.f, 1.f );
+
+	const int resolution = max( 1, (int)sqrtf( float( count ) * 0.5f ) );
+	const float size = 100.f;
+	const float cell = size / float( resolution );
+	const float phaseX = uniform( rng ) * 2.f * PI, phaseZ = uniform( rng ) * 2.f * PI;
+
+	vector<float> height( ( resolution + 1 ) * ( resolution + 1 ) );
+	for ( int z = 0; z <= resolution; z++ )
+	{
+		for ( int x = 0; x <= resolution; x++ )
+		{
+			float fx = float( x ) * cell, fz = float( z ) * cell;
+			height[z * ( resolution + 1 ) + x] = 4.f * sinf( fx * 0.1f + phaseX ) * cosf( fz * 0.13f + phaseZ ) + sinf( fx * 0.7f ) * sinf( fz * 0.5f ) + 0.2f * uniform( rng );
+		}
+	}
+
+	auto point = [&]( int x, int z ) {
+		return vec3( float( x ) * cell - 0.5f * size, height[z * ( resolution + 1 ) + x], float( z ) * cell - 0.5f * size );
+	};
+
+	vector<Primitive *> result;
+	result.reserve( 2 * resolution * resolution );
+
+	for ( int z = 0; z < resolution; z++ )
+	{
+		for ( int x = 0; x < resolution; x++ )
+		{
+			result.push_back( makeTriangle( point( x, z ), point( x, z + 1 ), point( x + 1, z + 1 ), mat ) );
+			result.push_back( makeTriangle( point( x, z ), point( x + 1, z + 1 ), point( x + 1, z ), mat ) );
+		}
+	}
+
+	return result;
+}
+
+// Copies of a 256 triangle sphere, one unit apart in the xz plane
+vector<Primitive *> generateMeshGrid( size_t count, const Material &mat )
+{
+	const vector<Primitive *> mesh = generateTessellatedSphere( 256, vec3( 0.f, 0.f, 0.f ), 0.4f, mat );
+	const size_t copies = max( (size_t)1, ( count + mesh.size() - 1 ) / mesh.size() );
+	const int side = (int)ceilf( sqrtf( float( copies ) ) );
+
+	vector<Primitive *> result;
+	result.reserve( copies * mesh.size() );
+
+	for ( size_t i = 0; i < copies; i++ )
+	{
+		const vec3 offset = vec3( float( i % side ) - 0.5f * side, 0.f, float( i / side ) - 0.5f * side );
+
+		for ( Primitive *p : mesh )
+		{
+			const Triangle *t = static_cast<Triangle *>( p );
+			result.push_back( makeTriangle( t->v0 + offset, t->v1 + offset, t->v2 + offset, mat ) );
+		}
+	}
+
+	for ( Primitive *p : mesh )
+	{
+		delete p;
+	}
+
+	return result;
+}
+
+// The cases a SAH builder handles worst, in a 20 unit cube:
+// 10% huge triangles that span the whole scene, 45% slivers and 45% small triangles piled up on one spot
+vector<Primitive *> generateDegenerate( size_t count, unsigned seed, const Material &mat )
+{
+	mt19937 rng( seed );
+	uniform_real_distribution<float> uniform( -1.f, 1.f );
+
+	auto randomPoint = [&]( float scale ) { return vec3( uniform( rng ), uniform( rng ), uniform( rng ) ) * scale; };
+
+	vector<Primitive *> result;
+	result.reserve( count );
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		const size_t kind = i % 20;
+
+		if ( kind < 2 )
+		{
+			result.push_back( makeTriangle( randomPoint( 10.f ), randomPoint( 10.f ), randomPoint( 10.f ), mat ) );
+		}
+		else if ( kind < 11 )
+		{
+			// Nearly collinear verteces
+			vec3 a = randomPoint( 10.f ), b = randomPoint( 10.f );
+			result.push_back( makeTriangle( a, b, ( a + b ) * 0.5f + randomPoint( 1e-4f ), mat ) );
+		}
+		else
+		{
+			vec3 a = randomPoint( 0.1f );
+			result.push_back( makeTriangle( a, a + randomPoint( 0.05f ), a + randomPoint( 0.05f ), mat ) );
+		}
+	}
+
+	return result;
+}
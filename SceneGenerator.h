@@ -0,0 +1,22 @@
+#pragma once
+
+// Procedural stress scenes for scalability tests
+// Every generator returns about 'count' primitives, owned by the caller, and is deterministic for a given seed.
+enum StressScene
+{
+	SPHERE_FIELD,		// Random spheres at a constant density
+	TESSELLATED_SPHERE, // One sphere made of triangles
+	TERRAIN,			// Height field of triangles
+	MESH_GRID,			// Copies of a small tessellated sphere on a grid, the tree has no instancing
+	DEGENERATE,			// Huge overlapping triangles, slivers and a pile of triangles on one spot
+	STRESS_SCENE_COUNT
+};
+
+const char *stressSceneName( StressScene type );
+vector<Primitive *> generateStressScene( StressScene type, size_t count, unsigned seed, const Material &mat );
+
+vector<Primitive *> generateSphereField( size_t count, unsigned seed, const Material &mat );
+vector<Primitive *> generateTessellatedSphere( size_t count, const vec3 &center, float radius, const Material &mat );
+vector<Primitive *> generateTerrain( size_t count, unsigned seed, const Material &mat );
+vector<Primitive *> generateMeshGrid( size_t count, const Material &mat );
+vector<Primitive *> generateDegenerate( size_t count, unsigned seed, const Material &mat );
@@ -0,0 +1,181 @@
+#include "precomp.h"
+
+SceneQuery::SceneQuery( SceneManager &scenes ) : scenes( scenes )
+{
+}
+
+QueryHit SceneQuery::intersect( const Ray &ray ) const
+{
+	const Scene *scene = scenes.acquire();
+	QueryHit result = intersect( scene->getBVH(), ray );
+	scenes.release();
+
+	return result;
+}
+
+bool SceneQuery::occluded( const Ray &ray, float maxT ) const
+{
+	const Scene *scene = scenes.acquire();
+	bool result = occluded( scene->getBVH(), ray, maxT );
+	scenes.release();
+
+	return result;
+}
+
+QueryHit SceneQuery::intersect( const BVH &bvh, const Ray &ray )
+{
+	Hit h = bvh.intersect( ray );
+
+	QueryHit result;
+	result.t = FLT_MAX;
+	result.primitiveId = -1;
+	result.b0 = 0.f;
+	result.b1 = 0.f;
+
+	if ( h.hitType != 0 )
+	{
+		result.t = h.t;
+		result.primitiveId = h.primitiveId;
+		result.b0 = h.barycentrics.x;
+		result.b1 = h.barycentrics.y;
+	}
+
+	return result;
+}
+
+bool SceneQuery::occluded( const BVH &bvh, const Ray &ray, float maxT )
+{
+	int occluder = -1;
+	return bvh.occluded( ray, maxT, -1, occluder );
+}
+
+void SceneQuery::intersect( const Ray *rays, size_t count, QueryHit *hits ) const
+{
+	const Scene *scene = scenes.acquire();
+	const BVH &bvh = scene->getBVH();
+
+	if ( count <= QUERYBATCH )
+	{
+		PERF_SCOPE( PERF_TRAVERSE );
+		for ( size_t i = 0; i < count; i++ )
+		{
+			hits[i] = intersect( bvh, rays[i] );
+		}
+	}
+	else
+	{
+		vector<unsigned> order = coherentOrder( rays, count );
+		int batches = int( ( count + QUERYBATCH - 1 ) / QUERYBATCH );
+
+#pragma omp parallel for schedule( dynamic )
+		for ( int b = 0; b < batches; b++ )
+		{
+			PERF_SCOPE( PERF_TRAVERSE );
+			size_t end = min( count, size_t( b + 1 ) * QUERYBATCH );
+			for ( size_t i = size_t( b ) * QUERYBATCH; i < end; i++ )
+			{
+				hits[order[i]] = intersect( bvh, rays[order[i]] );
+			}
+		}
+	}
+
+	scenes.release();
+}
+
+void SceneQuery::occluded( const Ray *rays, const float *maxT, size_t count, uint *occludedBits ) const
+{
+	const Scene *scene = scenes.acquire();
+	const BVH &bvh = scene->getBVH();
+
+	// Bits are packed afterwards, so threads never write to the same word
+	vector<char> result( count );
+
+	if ( count <= QUERYBATCH )
+	{
+		PERF_SCOPE( PERF_TRAVERSE );
+		for ( size_t i = 0; i < count; i++ )
+		{
+			result[i] = occluded( bvh, rays[i], maxT[i] );
+		}
+	}
+	else
+	{
+		vector<unsigned> order = coherentOrder( rays, count );
+		int batches = int( ( count + QUERYBATCH - 1 ) / QUERYBATCH );
+
+#pragma omp parallel for schedule( dynamic )
+		for ( int b = 0; b < batches; b++ )
+		{
+			PERF_SCOPE( PERF_TRAVERSE );
+			size_t end = min( count, size_t( b + 1 ) * QUERYBATCH );
+			for ( size_t i = size_t( b ) * QUERYBATCH; i < end; i++ )
+			{
+				result[order[i]] = occluded( bvh, rays[order[i]], maxT[order[i]] );
+			}
+		}
+	}
+
+	scenes.release();
+
+	for ( size_t w = 0; w < ( count + 31 ) / 32; w++ )
+	{
+		occludedBits[w] = 0;
+	}
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		if ( result[i] )
+		{
+			occludedBits[i / 32] |= 1u << ( i % 32 );
+		}
+	}
+}
+
+// Spreads the lower 10 bits of v so there are two zero bits between each of them
+static uint64 expandBits( uint64 v )
+{
+	v = ( v * 0x00010001u ) & 0xFF0000FFu;
+	v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+	v = ( v * 0x00000011u ) & 0xC30C30C3u;
+	v = ( v * 0x00000005u ) & 0x49249249u;
+	return v;
+}
+
+vector<unsigned> SceneQuery::coherentOrder( const Ray *rays, size_t count ) const
+{
+	// Bounds of the ray origins, to quantize them for the Morton code
+	aabb bounds = aabb();
+	bounds.Reset();
+	for ( size_t i = 0; i < count; i++ )
+	{
+		bounds.Grow( rays[i].origin );
+	}
+
+	// Sort key: direction octant first, then the Morton code of the origin
+	vector<pair<uint64, unsigned>> keys( count );
+	for ( size_t i = 0; i < count; i++ )
+	{
+		const Ray &r = rays[i];
+		uint64 octant = ( r.direction.x < 0.f ? 1 : 0 ) | ( r.direction.y < 0.f ? 2 : 0 ) | ( r.direction.z < 0.f ? 4 : 0 );
+		uint64 morton = 0;
+
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			float extend = bounds.Extend( axis );
+			float relative = extend > 0.f ? ( r.origin[axis] - bounds.bmin[axis] ) / extend : 0.f;
+			morton |= expandBits( uint64( clamp( relative, 0.f, 1.f ) * 1023.f ) ) << axis;
+		}
+
+		keys[i] = make_pair( ( octant << 30 ) | morton, (unsigned)i );
+	}
+
+	sort( keys.begin(), keys.end() );
+
+	vector<unsigned> order( count );
+	for ( size_t i = 0; i < count; i++ )
+	{
+		order[i] = keys[i].second;
+	}
+
+	return order;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Compact result of a ray query
+struct QueryHit
+{
+	float t;		 // FLT_MAX when nothing was hit
+	int primitiveId; // -1 when nothing was hit
+	float b0, b1;	// Barycentric coordinates, same convention as Triangle::hit, 0 for spheres
+};
+
+// Batched visibility queries against the scene, for code outside of the renderer (picking, audio occlusion, ...)
+// Every batch is a span of rays ( pointer + count ) with a matching span of results.
+// Rays are reordered internally by direction and origin, so neighbouring work items traverse the same nodes,
+// and work items of QUERYBATCH rays are spread over the threads. Results are always in the order of the input.
+// Each call sees one committed scene snapshot.
+class SceneQuery
+{
+  public:
+	SceneQuery( SceneManager &scenes );
+
+	// Closest hit for every ray
+	void intersect( const Ray *rays, size_t count, QueryHit *hits ) const;
+
+	// Bit i % 32 of occludedBits[i / 32] is set when ray i hits anything before maxT[i]
+	// occludedBits needs room for ( count + 31 ) / 32 words
+	void occluded( const Ray *rays, const float *maxT, size_t count, uint *occludedBits ) const;
+
+	// Single ray versions
+	QueryHit intersect( const Ray &ray ) const;
+	bool occluded( const Ray &ray, float maxT ) const;
+
+  private:
+	SceneManager &scenes;
+
+	static QueryHit intersect( const BVH &bvh, const Ray &ray );
+	static bool occluded( const BVH &bvh, const Ray &ray, float maxT );
+
+	// Indices of the rays, sorted so coherent rays are processed together
+	vector<unsigned> coherentOrder( const Ray *rays, size_t count ) const;
+};
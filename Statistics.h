@@ -0,0 +1,57 @@
+#pragma once
+
+enum StatCounter
+{
+	STAT_PRIMARY_RAYS, // Traced or rasterized, reused cache entries do not count
+	STAT_DIFFUSE_RAYS,
+	STAT_SHADOW_RAYS,
+	STAT_OCCLUDER_CACHE_HITS,
+
+	// Microseconds spent per stage of renderFrame()
+	STAT_SCENE_US, // Picking up scene edits
+	STAT_RASTER_US,
+	STAT_TILES_US,
+	STAT_COUNT
+};
+
+// Counters are written per thread without locks or atomics, and summed once per frame
+class Statistics
+{
+  public:
+	Statistics() { reset(); }
+
+	void add( StatCounter counter, uint64 amount = 1 )
+	{
+		perThread.local().counters[counter] += amount;
+	}
+
+	// Sum all threads into the totals of the last frame and start counting again
+	// Only call this while no render threads are running
+	void gather()
+	{
+		perThread.gather( &ThreadCounters::counters, totals );
+	}
+
+	void reset()
+	{
+		perThread.forEach( []( int, ThreadCounters &thread ) { memset( thread.counters, 0, sizeof( thread.counters ) ); } );
+		memset( totals, 0, sizeof( totals ) );
+	}
+
+	uint64 get( StatCounter counter ) const { return totals[counter]; }
+
+	// Fraction of a over b in the last frame, 0 when b is 0
+	float ratio( StatCounter a, StatCounter b ) const
+	{
+		return totals[b] == 0 ? 0.f : float( totals[a] ) / float( totals[b] );
+	}
+
+  private:
+	struct ThreadCounters
+	{
+		uint64 counters[STAT_COUNT];
+	};
+
+	PerThread<ThreadCounters> perThread;
+	uint64 totals[STAT_COUNT];
+};
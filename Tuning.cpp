@@ -0,0 +1,158 @@
+#include "precomp.h"
+
+Tuning tuning;
+
+BVHParameters Tuning::forScene( const vector<Primitive *> &primitives ) const
+{
+	const uint64 key = sceneKey( primitives );
+	for ( const pair<uint64, BVHParameters> &scene : scenes )
+	{
+		if ( scene.first == key )
+		{
+			return scene.second;
+		}
+	}
+
+	BVHParameters parameters;
+	parameters.traversalCost = traversalCost;
+	return parameters;
+}
+
+void Tuning::setScene( uint64 key, const BVHParameters &parameters )
+{
+	for ( pair<uint64, BVHParameters> &scene : scenes )
+	{
+		if ( scene.first == key )
+		{
+			scene.second = parameters;
+			return;
+		}
+	}
+	scenes.push_back( make_pair( key, parameters ) );
+}
+
+void Tuning::apply() const
+{
+#ifdef _OPENMP
+	if ( threads > 0 )
+	{
+		omp_set_num_threads( min( threads, MAXTHREADS ) );
+	}
+#endif
+}
+
+// tileSize <pixels>
+// threads <count>
+// traversalCost <cost>
+// scene <key> <binCount> <maxDepth> <leafSize> <traversalCost>
+bool Tuning::save( const char *filename ) const
+{
+	ofstream out( filename );
+	if ( !out )
+	{
+		return false;
+	}
+
+	out.precision( 9 );
+	out << "tileSize " << tileSize << endl;
+	out << "threads " << threads << endl;
+	out << "traversalCost " << traversalCost << endl;
+
+	for ( const pair<uint64, BVHParameters> &scene : scenes )
+	{
+		const BVHParameters &p = scene.second;
+		out << "scene " << scene.first << " " << p.binCount << " " << p.maxDepth << " " << p.leafSize << " " << p.traversalCost << endl;
+	}
+
+	return true;
+}
+
+// False for values the BVH build can not work with, as in a corrupt file
+static bool validParameters( const BVHParameters &p )
+{
+	return p.binCount >= 2 && p.binCount <= 1024 && p.leafSize >= 1 && p.maxDepth >= 1 && p.maxDepth <= 1024 && p.traversalCost >= 0.f &&
+		   p.traversalCost < FLT_MAX;
+}
+
+// Values are only taken over when the whole file can be read and every value is valid, otherwise every value
+// falls back to its default
+bool Tuning::load( const char *filename )
+{
+	*this = Tuning();
+
+	ifstream in( filename );
+	if ( !in )
+	{
+		return false;
+	}
+
+	Tuning loaded;
+	string tag;
+	while ( in >> tag )
+	{
+		if ( tag == "tileSize" ) in >> loaded.tileSize;
+		else if ( tag == "threads" ) in >> loaded.threads;
+		else if ( tag == "traversalCost" ) in >> loaded.traversalCost;
+		else if ( tag == "scene" )
+		{
+			uint64 key;
+			BVHParameters p;
+			in >> key >> p.binCount >> p.maxDepth >> p.leafSize >> p.traversalCost;
+			loaded.scenes.push_back( make_pair( key, p ) );
+		}
+		else return false;
+
+		if ( !in )
+		{
+			return false;
+		}
+	}
+
+	if ( loaded.tileSize == 0 || loaded.tileSize > (unsigned)max( SCRWIDTH, SCRHEIGHT ) || loaded.threads < 0 || loaded.threads > MAXTHREADS ||
+		 !( loaded.traversalCost >= 0.f && loaded.traversalCost < FLT_MAX ) )
+	{
+		return false;
+	}
+
+	for ( const pair<uint64, BVHParameters> &scene : loaded.scenes )
+	{
+		if ( !validParameters( scene.second ) )
+		{
+			return false;
+		}
+	}
+
+	*this = loaded;
+	return true;
+}
+
+aabb Tuning::sceneBounds( const vector<Primitive *> &primitives )
+{
+	aabb bounds;
+	bounds.Reset();
+	for ( Primitive *p : primitives )
+	{
+		bounds.Grow( p->volume() );
+	}
+	return bounds;
+}
+
+// FNV-1a over the count and the bounds
+uint64 Tuning::sceneKey( const vector<Primitive *> &primitives )
+{
+	const aabb bounds = sceneBounds( primitives );
+
+	uint64 hash = 14695981039346656037ull;
+	auto mix = [&hash]( const void *data, size_t bytes ) {
+		for ( size_t i = 0; i < bytes; i++ )
+		{
+			hash = ( hash ^ ( (const unsigned char *)data )[i] ) * 1099511628211ull;
+		}
+	};
+
+	const uint64 count = primitives.size();
+	mix( &count, sizeof( count ) );
+	mix( bounds.bmin, 3 * sizeof( float ) );
+	mix( bounds.bmax, 3 * sizeof( float ) );
+	return hash;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Build parameters of the BVH of one scene
+struct BVHParameters
+{
+	int binCount = BINCOUNT;				 // Candidate SAH splits per axis
+	int maxDepth = BVHDEPTH;
+	int leafSize = LEAFSIZE;				 // Nodes with fewer primitives stay leaves
+	float traversalCost = TRAVERSALCOST; // Of a traversal step, relative to one primitive intersection
+};
+
+// Constants that depend on the host and the scene, chosen by bench tune and stored in a text file.
+// Everything that is not in the file keeps the compile time value of precomp.h.
+class Tuning
+{
+  public:
+	unsigned tileSize = TILESIZE;
+	int threads = 0;					 // 0 leaves the OpenMP default
+	float traversalCost = TRAVERSALCOST; // Measured on this host, the default of scenes without their own parameters
+
+	// BVH parameters of the scene with these primitives, see sceneKey
+	BVHParameters forScene( const vector<Primitive *> &primitives ) const;
+	void setScene( uint64 key, const BVHParameters &parameters );
+
+	// Sets the thread count of OpenMP
+	void apply() const;
+
+	bool save( const char *filename ) const;
+	bool load( const char *filename );
+
+	// Primitive count and bounds of a scene, which is enough to recognise it on the next run
+	static uint64 sceneKey( const vector<Primitive *> &primitives );
+	static aabb sceneBounds( const vector<Primitive *> &primitives );
+
+  private:
+	vector<pair<uint64, BVHParameters>> scenes;
+};
+
+extern Tuning tuning;
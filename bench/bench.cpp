@@ -0,0 +1,443 @@
+// Microbenchmarks for the intersection and traversal kernels
+// Usage: bench [--assets dir] [--repeat n] [--seed n] [--out file.json] [--baseline file.json] [--threshold fraction] [--perf]
+// Every kernel runs on one thread over a precomputed ray set, the fastest of the repeats is reported.
+// With --baseline, any result more than threshold slower than the baseline is a regression (exit code 1).
+// With --perf, every kernel runs once more with hardware counters, which adds IPC and misses per
+// thousand instructions to its result (Linux only, see PerfCounters.h).
+// Peak memory per category while a scene is loaded and benchmarked is reported in bytes, and compared
+// to the baseline like the timings.
+// Other modes are selected by the first argument, see main()
+
+#include "precomp.h"
+#include "bench.h"
+
+struct Options
+{
+	string assets = "assets";
+	string out;
+	string baseline;
+	float threshold = 0.1f;
+	int repeat = 5;
+	unsigned seed = 1234;
+	bool perf = false;
+};
+
+struct Result
+{
+	string name;
+	string unit;  // "ns/ray", "ns/test", "ms" or "bytes"
+	float value;  // Lower is better
+	size_t count; // Rays or tests per run, 0 for build times
+	bool counted = false;
+	PerfSample perf = PerfSample(); // With --perf
+};
+
+volatile int sink;
+
+// The scene of Game::Init, the only one that uses spheres
+vector<Primitive *> sphereScene()
+{
+	Material mat;
+	mat.type = MaterialType::EMIT_MAT;
+	mat.albedo = vec3( 1.f, 1.f, 1.f );
+	mat.emission = vec3( 10.f, 10.f, 10.f );
+
+	vector<Primitive *> scene;
+	scene.push_back( new Sphere( vec3( 0.f, -10.f, 15.f ), 3.f, mat ) );
+
+	mat.type = MaterialType::LAMBERTIAN_MAT;
+	mat.emission = vec3( 0.f, 0.f, 0.f );
+	mat.albedo = vec3( 0.25f, 0.25f, 0.25f );
+	scene.push_back( new Sphere( vec3( 0.f, 1e5f - 10.f, 15.f ), 1e5f, mat ) );
+	mat.albedo = vec3( 0.75f, 0.25f, 0.25f );
+	scene.push_back( new Sphere( vec3( 0.f, 1e5f + 5.f, 15.f ), 1e5f, mat ) );
+	mat.albedo = vec3( 0.25f, 0.25f, 0.75f );
+	scene.push_back( new Sphere( vec3( 0.f, 0.f, 1e5f + 20.f ), 1e5f, mat ) );
+	mat.albedo = vec3( 0.25f, 0.75f, 0.25f );
+	scene.push_back( new Sphere( vec3( -3.f, 0.f, 12.f ), 2.f, mat ) );
+	mat.albedo = vec3( 0.1f, 0.3f, 0.6f );
+	scene.push_back( new Sphere( vec3( 4.f, -2.5f, 12.f ), 2.f, mat ) );
+
+	return scene;
+}
+
+Camera gameCamera()
+{
+	return Camera( vec3( 0.f, 0.f, -2.f ), vec3( 0.f, 0.f, 0.f ), vec3( 0.f, 1.f, 0.f ), PI / 4, (float)SCRWIDTH / (float)SCRHEIGHT, 0.f, 0.5f, 1.f );
+}
+
+// Primary rays of a 256 x 256 view, with diffuse and shadow rays from their hits
+// The camera looks at the scene from outside its bounds, unless a camera is given
+RaySets makeRaySets( const BVH &bvh, const aabb &bounds, const Camera *view, unsigned seed )
+{
+	const int resolution = 256;
+	mt19937 rng( seed );
+	uniform_real_distribution<float> uniform( 0.f, 1.f );
+
+	const vec3 center = ( bounds.bmin3 + bounds.bmax3 ) * 0.5f;
+	const float radius = ( bounds.bmax3 - bounds.bmin3 ).length() * 0.5f;
+	const Camera cam = view ? *view : Camera( center - vec3( 0.f, 0.f, 2.2f * radius ), center, vec3( 0.f, 1.f, 0.f ), PI / 4, 1.f, 0.f, 0.5f, 1.f );
+	const vec3 light = center + vec3( 0.f, -2.f * radius, -radius );
+
+	Sample sample;
+	RaySets sets;
+
+	for ( int y = 0; y < resolution; y++ )
+	{
+		for ( int x = 0; x < resolution; x++ )
+		{
+			Ray r = cam.getPinholeRay( ( x + uniform( rng ) ) * SCRWIDTH / resolution, ( y + uniform( rng ) ) * SCRHEIGHT / resolution );
+			sets.primary.push_back( r );
+
+			Hit h = bvh.intersect( r );
+			if ( h.hitType == 0 )
+			{
+				continue;
+			}
+
+			// Uniform direction on the hemisphere around the normal
+			vec3 tangent = normalize( abs( h.normal.x ) > 0.5f ? cross( h.normal, vec3( 0.f, 1.f, 0.f ) ) : cross( h.normal, vec3( 1.f, 0.f, 0.f ) ) );
+			vec3 bitangent = cross( h.normal, tangent );
+			vec3 p = sample.uniformSampleHemisphere( uniform( rng ), uniform( rng ) );
+
+			Ray diffuse;
+			diffuse.direction = normalize( tangent * p.x + h.normal * p.y + bitangent * p.z );
+			diffuse.origin = h.coordinates + SHADOWBIAS * diffuse.direction;
+			sets.diffuse.push_back( diffuse );
+
+			vec3 toLight = light - h.coordinates;
+			float distance = toLight.length();
+
+			Ray shadow;
+			shadow.direction = toLight * ( 1.f / distance );
+			shadow.origin = h.coordinates + SHADOWBIAS * shadow.direction;
+			sets.shadow.push_back( shadow );
+			sets.shadowT.push_back( distance );
+		}
+	}
+
+	return sets;
+}
+
+// Runs the kernel once more with hardware counters for the result
+template <typename Kernel>
+static void countEvents( const Options &options, PerfPhase phase, Result &result, Kernel kernel )
+{
+	if ( !options.perf )
+	{
+		return;
+	}
+
+	perfCounters.start();
+	if ( phase == PERF_BUILD )
+	{
+		kernel(); // BVH construction counts itself
+	}
+	else
+	{
+		PerfScope scope( phase );
+		kernel();
+	}
+	perfCounters.gather();
+	perfCounters.stop();
+
+	result.counted = perfCounters.isAvailable();
+	result.perf = perfCounters.get( phase );
+}
+
+// Peak bytes per category since the last MemoryTracker::resetPeaks()
+static void memoryResults( const string &name, vector<Result> &results )
+{
+	for ( int c = 0; c < MEM_CATEGORY_COUNT; c++ )
+	{
+		const int64 peak = memoryTracker.peak( (MemoryCategory)c );
+		if ( peak > 0 )
+		{
+			results.push_back( {name + "/memory/" + MemoryTracker::categoryName( (MemoryCategory)c ), "bytes", float( peak ), 0} );
+		}
+	}
+}
+
+static void benchScene( const string &name, const vector<Primitive *> &primitives, const Camera *view, const Options &options, vector<Result> &results )
+{
+	for ( size_t i = 0; i < primitives.size(); i++ )
+	{
+		primitives[i]->id = (int)i;
+	}
+
+	const aabb bounds = Tuning::sceneBounds( primitives );
+
+	auto build = [&]() { BVH bvh( primitives ); };
+	results.push_back( {name + "/build", "ms", fastest( options.repeat, build ), 0} );
+	countEvents( options, PERF_BUILD, results.back(), build );
+
+	const BVH bvh( primitives );
+	const RaySets sets = makeRaySets( bvh, bounds, view, options.seed );
+
+	auto perRay = []( float ms, size_t count ) { return count ? ms * 1e6f / float( count ) : 0.f; };
+
+	auto primary = [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.primary ) hits += bvh.intersect( r ).hitType != 0;
+		sink = hits;
+	};
+	results.push_back( {name + "/primary/intersect", "ns/ray", perRay( fastest( options.repeat, primary ), sets.primary.size() ), sets.primary.size()} );
+	countEvents( options, PERF_TRAVERSE, results.back(), primary );
+
+	auto diffuse = [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.diffuse ) hits += bvh.intersect( r ).hitType != 0;
+		sink = hits;
+	};
+	results.push_back( {name + "/diffuse/intersect", "ns/ray", perRay( fastest( options.repeat, diffuse ), sets.diffuse.size() ), sets.diffuse.size()} );
+	countEvents( options, PERF_TRAVERSE, results.back(), diffuse );
+
+	auto shadow = [&]() {
+		int hits = 0, occluder;
+		for ( size_t i = 0; i < sets.shadow.size(); i++ ) hits += bvh.occluded( sets.shadow[i], sets.shadowT[i], -1, occluder );
+		sink = hits;
+	};
+	results.push_back( {name + "/shadow/occluded", "ns/ray", perRay( fastest( options.repeat, shadow ), sets.shadow.size() ), sets.shadow.size()} );
+	countEvents( options, PERF_TRAVERSE, results.back(), shadow );
+
+	// Primitive and bounds tests against the first primitives of the scene, as in a BVH leaf
+	const size_t testCount = min( primitives.size(), (size_t)32 );
+	vector<aabb> testBounds;
+	for ( size_t i = 0; i < testCount; i++ )
+	{
+		testBounds.push_back( primitives[i]->volume() );
+	}
+
+	auto primitiveTests = [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.primary )
+			for ( size_t i = 0; i < testCount; i++ ) hits += primitives[i]->hit( r ).hitType != 0;
+		sink = hits;
+	};
+	const string kernel = dynamic_cast<Sphere *>( primitives[0] ) ? "/sphere/hit" : "/triangle/hit";
+	results.push_back( {name + kernel, "ns/test", perRay( fastest( options.repeat, primitiveTests ), sets.primary.size() * testCount ), sets.primary.size() * testCount} );
+	countEvents( options, PERF_TRAVERSE, results.back(), primitiveTests );
+
+	auto boundsTests = [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.primary )
+			for ( const aabb &b : testBounds ) hits += BVHNode::rayIntersectsBounds( b, r );
+		sink = hits;
+	};
+	results.push_back( {name + "/bounds", "ns/test", perRay( fastest( options.repeat, boundsTests ), sets.primary.size() * testCount ), sets.primary.size() * testCount} );
+	countEvents( options, PERF_TRAVERSE, results.back(), boundsTests );
+}
+
+static void writeJSON( ostream &out, const vector<Result> &results )
+{
+	out << "{" << endl;
+	out << "  \"samples_per_result\": \"fastest of repeats, single thread\"," << endl;
+	out << "  \"results\": [" << endl;
+
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		const Result &r = results[i];
+		char line[512], perf[256] = "";
+		// 0 for a result too fast to time, JSON has no infinity
+		float perSecond = r.unit == "ms" || r.unit == "bytes" || r.value <= 0.f ? 0.f : 1e9f / r.value;
+		if ( r.counted )
+		{
+			snprintf( perf, sizeof( perf ), ", \"ipc\": %.3f, \"cache_mpki\": %.3f, \"branch_mpki\": %.3f", r.perf.ipc(), r.perf.mpki( PERF_CACHE_MISSES ), r.perf.mpki( PERF_BRANCH_MISSES ) );
+		}
+		snprintf( line, sizeof( line ), "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.4f, \"count\": %zu, \"per_second_per_core\": %.0f%s}%s",
+				  r.name.c_str(), r.unit.c_str(), r.value, r.count, perSecond, perf, i + 1 < results.size() ? "," : "" );
+		out << line << endl;
+	}
+
+	out << "  ]" << endl;
+	out << "}" << endl;
+}
+
+// Reads the output of writeJSON, one result per line
+static bool readBaseline( const string &filename, vector<Result> &baseline )
+{
+	ifstream in( filename );
+	if ( !in )
+	{
+		return false;
+	}
+
+	string line;
+	while ( getline( in, line ) )
+	{
+		size_t name = line.find( "\"name\": \"" );
+		size_t value = line.find( "\"value\": " );
+		if ( name == string::npos || value == string::npos )
+		{
+			continue;
+		}
+
+		name += 9;
+		Result r;
+		r.name = line.substr( name, line.find( '"', name ) - name );
+		r.value = (float)atof( line.c_str() + value + 9 );
+		r.count = 0;
+		baseline.push_back( r );
+	}
+
+	return true;
+}
+
+static int compare( const vector<Result> &results, const vector<Result> &baseline, float threshold )
+{
+	int regressions = 0;
+
+	for ( const Result &b : baseline )
+	{
+		for ( const Result &r : results )
+		{
+			if ( r.name != b.name || b.value <= 0.f )
+			{
+				continue;
+			}
+
+			float change = r.value / b.value - 1.f;
+			bool regressed = change > threshold;
+			regressions += regressed;
+
+			fprintf( stderr, "%-32s %10.3f -> %10.3f %s (%+.1f%%)%s\n", r.name.c_str(), b.value, r.value, r.unit.c_str(), change * 100.f, regressed ? "  REGRESSION" : "" );
+		}
+	}
+
+	return regressions;
+}
+
+static bool parseOptions( int argc, char **argv, Options &options )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[i];
+		if ( arg == "--perf" )
+		{
+			options.perf = true;
+			continue;
+		}
+
+		if ( i + 1 >= argc )
+		{
+			return false;
+		}
+
+		if ( arg == "--assets" ) options.assets = argv[++i];
+		else if ( arg == "--out" ) options.out = argv[++i];
+		else if ( arg == "--baseline" ) options.baseline = argv[++i];
+		else if ( arg == "--threshold" ) options.threshold = (float)atof( argv[++i] );
+		else if ( arg == "--repeat" ) options.repeat = max( 1, atoi( argv[++i] ) );
+		else if ( arg == "--seed" ) options.seed = (unsigned)atoi( argv[++i] );
+		else return false;
+	}
+
+	return true;
+}
+
+static int runKernels( int argc, char **argv )
+{
+	Options options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench [--assets dir] [--repeat n] [--seed n] [--out file.json] [--baseline file.json] [--threshold fraction] [--perf]\n" );
+		return 2;
+	}
+
+	vector<Result> results;
+
+	const Camera gameCam = gameCamera();
+	memoryTracker.resetPeaks();
+	vector<Primitive *> spheres = sphereScene();
+	benchScene( "spheres", spheres, &gameCam, options, results );
+	memoryResults( "spheres", results );
+	for ( Primitive *p : spheres ) delete p;
+
+	Material mat;
+	mat.type = MaterialType::LAMBERTIAN_MAT;
+	mat.albedo = vec3( 0.5f, 0.5f, 0.5f );
+	mat.emission = vec3( 0.f, 0.f, 0.f );
+
+	for ( const char *mesh : {"Cube", "Monkey", "icoSphere", "scene"} )
+	{
+		string filename = options.assets + "/" + mesh + ".obj";
+		memoryTracker.resetPeaks();
+		vector<Primitive *> primitives = loadOBJ( filename.c_str(), mat );
+
+		if ( primitives.empty() )
+		{
+			fprintf( stderr, "skipping %s, could not load %s\n", mesh, filename.c_str() );
+			continue;
+		}
+
+		benchScene( mesh, primitives, nullptr, options, results );
+		memoryResults( mesh, results );
+		for ( Primitive *p : primitives ) delete p;
+	}
+
+	if ( options.out.empty() )
+	{
+		writeJSON( cout, results );
+	}
+	else
+	{
+		ofstream out( options.out );
+		writeJSON( out, results );
+	}
+
+	if ( options.perf && !perfCounters.isAvailable() )
+	{
+		fprintf( stderr, "hardware counters unavailable: no permission (see /proc/sys/kernel/perf_event_paranoid) or no PMU, e.g. in a VM\n" );
+	}
+
+	if ( !options.baseline.empty() )
+	{
+		vector<Result> baseline;
+		if ( !readBaseline( options.baseline, baseline ) )
+		{
+			fprintf( stderr, "could not read baseline %s\n", options.baseline.c_str() );
+			return 2;
+		}
+
+		int regressions = compare( results, baseline, options.threshold );
+		fprintf( stderr, "%d regression(s) above %.1f%%\n", regressions, options.threshold * 100.f );
+		return regressions > 0 ? 1 : 0;
+	}
+
+	return 0;
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc > 1 && string( argv[1] ) == "convergence" )
+	{
+		return runConvergence( argc - 1, argv + 1 );
+	}
+
+	if ( argc > 1 && string( argv[1] ) == "scale" )
+	{
+		return runScale( argc - 1, argv + 1 );
+	}
+
+	if ( argc > 1 && string( argv[1] ) == "fastmath" )
+	{
+		return runFastMath( argc - 1, argv + 1 );
+	}
+
+	if ( argc > 1 && string( argv[1] ) == "tune" )
+	{
+		return runTune( argc - 1, argv + 1 );
+	}
+
+	if ( argc > 1 && string( argv[1] ) == "coordinator" )
+	{
+		return runCoordinator( argc - 1, argv + 1 );
+	}
+
+	if ( argc > 1 && string( argv[1] ) == "worker" )
+	{
+		return runWorkerMode( argc - 1, argv + 1 );
+	}
+
+	return runKernels( argc, argv );
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Shared by the benchmark modes
+
+// Keeps the compiler from removing a kernel whose result is not used
+extern volatile int sink;
+
+// Milliseconds of the fastest of repeat runs
+template <typename Kernel>
+float fastest( int repeat, Kernel kernel )
+{
+	float best = FLT_MAX;
+	for ( int i = 0; i < repeat; i++ )
+	{
+		timer t;
+		kernel();
+		best = min( best, t.elapsed() );
+	}
+	return best;
+}
+
+// The scene and camera of Game::Init
+vector<Primitive *> sphereScene();
+Camera gameCamera();
+
+// Primary rays of a 256 x 256 view, with a diffuse and a shadow ray for every primary hit
+struct RaySets
+{
+	vector<Ray> primary;
+	vector<Ray> diffuse;
+	vector<Ray> shadow;
+	vector<float> shadowT;
+};
+
+// The camera looks at the bounds from outside, unless a view is given
+RaySets makeRaySets( const BVH &bvh, const aabb &bounds, const Camera *view, unsigned seed );
+
+// bench convergence ..., see convergence.cpp
+int runConvergence( int argc, char **argv );
+
+// bench scale ..., see scale.cpp
+int runScale( int argc, char **argv );
+
+// bench fastmath ..., see fastmath.cpp
+int runFastMath( int argc, char **argv );
+
+// bench tune ..., see tune.cpp
+int runTune( int argc, char **argv );
+
+// bench coordinator ... and bench worker ..., see distributed.cpp
+int runCoordinator( int argc, char **argv );
+int runWorkerMode( int argc, char **argv );
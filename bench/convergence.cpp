@@ -0,0 +1,242 @@
+// Time to quality: how fast does the renderer approach a high spp reference of the Game::Init scene
+// Usage: bench convergence [--reference file.pfm] [--reference-spp n] [--spp n] [--seconds t]
+//                          [--csv file.csv] [--targets relMSE,relMSE,...] [--crop x0,y0,x1,y1]
+// The reference is loaded from --reference when that file exists, otherwise it is rendered (and saved there).
+// With --crop only the tiles that intersect the rectangle are rendered and only its pixels are compared,
+// a reference rendered with --crop is black outside of it.
+// The primary hit cache and foveation are off for the reference and the measured run, so every iteration is one
+// new sample per pixel.
+// Every iteration adds a row spp,time_ms,rmse,relmse to the CSV, time_ms only counts rendering.
+
+#include "precomp.h"
+#include "bench.h"
+
+struct ConvergenceOptions
+{
+	string reference;
+	string csv = "convergence.csv";
+	unsigned referenceSpp = 1024;
+	unsigned spp = 256;
+	float seconds = FLT_MAX;
+	vector<float> targets = {0.1f, 0.03f, 0.01f};
+	int crop[4] = {0, 0, SCRWIDTH, SCRHEIGHT};
+};
+
+// Portable float map, rows are stored bottom to top
+static bool writePFM( const string &filename, const vector<vec3> &image )
+{
+	FILE *f = fopen( filename.c_str(), "wb" );
+	if ( !f )
+	{
+		return false;
+	}
+
+	fprintf( f, "PF\n%d %d\n-1.0\n", SCRWIDTH, SCRHEIGHT );
+	for ( int y = SCRHEIGHT - 1; y >= 0; y-- )
+	{
+		for ( int x = 0; x < SCRWIDTH; x++ )
+		{
+			const vec3 &c = image[y * SCRWIDTH + x];
+			float rgb[3] = {c.x, c.y, c.z};
+			fwrite( rgb, sizeof( float ), 3, f );
+		}
+	}
+
+	fclose( f );
+	return true;
+}
+
+static bool readPFM( const string &filename, vector<vec3> &image )
+{
+	FILE *f = fopen( filename.c_str(), "rb" );
+	if ( !f )
+	{
+		return false;
+	}
+
+	int width = 0, height = 0;
+	float scale = 0.f;
+	bool ok = fscanf( f, "PF %d %d %f", &width, &height, &scale ) == 3 && fgetc( f ) != EOF && width == SCRWIDTH && height == SCRHEIGHT && scale < 0.f;
+
+	image.resize( SCRWIDTH * SCRHEIGHT );
+	for ( int y = SCRHEIGHT - 1; ok && y >= 0; y-- )
+	{
+		for ( int x = 0; ok && x < SCRWIDTH; x++ )
+		{
+			float rgb[3];
+			ok = fread( rgb, sizeof( float ), 3, f ) == 3;
+			image[y * SCRWIDTH + x] = vec3( rgb[0], rgb[1], rgb[2] );
+		}
+	}
+
+	fclose( f );
+	return ok;
+}
+
+// Renders spp iterations of the Game::Init scene, calling progress( renderer, milliseconds ) after each one
+template <typename Progress>
+static void render( unsigned spp, float seconds, const int *crop, Progress progress )
+{
+	Renderer renderer( sphereScene() );
+	renderer.setCamera( gameCamera() );
+	renderer.setMaxIterations( spp );
+	renderer.setCrop( crop[0], crop[1], crop[2], crop[3] );
+
+	// The cache would repeat the same few primary hits, every iteration has to be a new sample
+	renderer.setPrimaryCache( false );
+
+	// Extra samples around the focus point would make the spp column count iterations instead
+	renderer.setFoveation( false );
+
+	float elapsed = 0.f;
+	while ( renderer.getIteration() < spp && elapsed < seconds * 1000.f )
+	{
+		timer t;
+		renderer.renderFrame();
+		elapsed += t.elapsed();
+
+		progress( renderer, elapsed );
+	}
+}
+
+// Over the pixels of the crop
+static void errors( const vector<vec3> &image, const vector<vec3> &reference, const int *crop, float &rmse, float &relMSE )
+{
+	double squared = 0.0, relative = 0.0;
+
+	for ( int y = crop[1]; y < crop[3]; y++ )
+	{
+		for ( int x = crop[0]; x < crop[2]; x++ )
+		{
+			const size_t i = y * SCRWIDTH + x;
+			for ( int c = 0; c < 3; c++ )
+			{
+				double d = image[i][c] - reference[i][c];
+				double r = reference[i][c];
+				squared += d * d;
+				relative += d * d / ( r * r + 0.01 );
+			}
+		}
+	}
+
+	const size_t count = size_t( crop[2] - crop[0] ) * ( crop[3] - crop[1] ) * 3;
+	rmse = (float)sqrt( squared / count );
+	relMSE = (float)( relative / count );
+}
+
+static bool parseOptions( int argc, char **argv, ConvergenceOptions &options )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[i];
+		if ( i + 1 >= argc )
+		{
+			return false;
+		}
+
+		if ( arg == "--reference" ) options.reference = argv[++i];
+		else if ( arg == "--reference-spp" ) options.referenceSpp = max( 1, atoi( argv[++i] ) );
+		else if ( arg == "--spp" ) options.spp = max( 1, atoi( argv[++i] ) );
+		else if ( arg == "--seconds" ) options.seconds = (float)atof( argv[++i] );
+		else if ( arg == "--csv" ) options.csv = argv[++i];
+		else if ( arg == "--crop" )
+		{
+			int *c = options.crop;
+			if ( sscanf( argv[++i], "%d,%d,%d,%d", &c[0], &c[1], &c[2], &c[3] ) != 4 )
+			{
+				return false;
+			}
+
+			c[0] = max( c[0], 0 ), c[1] = max( c[1], 0 );
+			c[2] = min( c[2], SCRWIDTH ), c[3] = min( c[3], SCRHEIGHT );
+			if ( c[2] <= c[0] || c[3] <= c[1] )
+			{
+				return false;
+			}
+		}
+		else if ( arg == "--targets" )
+		{
+			options.targets.clear();
+			stringstream list( argv[++i] );
+			string target;
+			while ( getline( list, target, ',' ) )
+			{
+				options.targets.push_back( (float)atof( target.c_str() ) );
+			}
+		}
+		else return false;
+	}
+
+	return true;
+}
+
+int runConvergence( int argc, char **argv )
+{
+	ConvergenceOptions options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench convergence [--reference file.pfm] [--reference-spp n] [--spp n] [--seconds t] [--csv file.csv] [--targets relMSE,...] [--crop x0,y0,x1,y1]\n" );
+		return 2;
+	}
+
+	vector<vec3> reference( SCRWIDTH * SCRHEIGHT );
+	vector<vec3> image( SCRWIDTH * SCRHEIGHT );
+
+	if ( options.reference.empty() || !readPFM( options.reference, reference ) )
+	{
+		fprintf( stderr, "rendering a %u spp reference\n", options.referenceSpp );
+		render( options.referenceSpp, FLT_MAX, options.crop, [&]( Renderer &renderer, float elapsed ) {
+			if ( renderer.getIteration() % 64 == 0 )
+			{
+				fprintf( stderr, "  %u spp, %.1f s\n", renderer.getIteration(), elapsed / 1000.f );
+			}
+
+			if ( renderer.getIteration() == options.referenceSpp )
+			{
+				renderer.getRadiance( reference.data() );
+			}
+		} );
+
+		if ( !options.reference.empty() && !writePFM( options.reference, reference ) )
+		{
+			fprintf( stderr, "could not write %s\n", options.reference.c_str() );
+		}
+	}
+
+	ofstream csv( options.csv );
+	csv << "spp,time_ms,rmse,relmse" << endl;
+
+	vector<float> reachedTime( options.targets.size(), -1.f );
+	vector<unsigned> reachedSpp( options.targets.size(), 0 );
+	float rmse = 0.f, relMSE = 0.f;
+
+	render( options.spp, options.seconds, options.crop, [&]( Renderer &renderer, float elapsed ) {
+		renderer.getRadiance( image.data() );
+		errors( image, reference, options.crop, rmse, relMSE );
+		csv << renderer.getIteration() << "," << elapsed << "," << rmse << "," << relMSE << endl;
+
+		for ( size_t i = 0; i < options.targets.size(); i++ )
+		{
+			if ( reachedTime[i] < 0.f && relMSE <= options.targets[i] )
+			{
+				reachedTime[i] = elapsed;
+				reachedSpp[i] = renderer.getIteration();
+			}
+		}
+	} );
+
+	printf( "final: rmse %.5f relMSE %.5f\n", rmse, relMSE );
+	for ( size_t i = 0; i < options.targets.size(); i++ )
+	{
+		if ( reachedTime[i] < 0.f )
+		{
+			printf( "relMSE %g: not reached\n", options.targets[i] );
+		}
+		else
+		{
+			printf( "relMSE %g: %.1f ms, %u spp\n", options.targets[i], reachedTime[i], reachedSpp[i] );
+		}
+	}
+
+	return 0;
+}
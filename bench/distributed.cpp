@@ -0,0 +1,192 @@
+// Distributed rendering of the Game::Init scene by worker processes on this machine, see Distributed.h
+// Usage: bench coordinator [--port n] [--spp n] [--seed n] [--cache file] [--spawn n] [--leave n] [--verify]
+//        bench worker [--host address] [--port n] [--leave n]
+// The coordinator writes the scene cache to --cache and renders --spp iterations with the workers that connect.
+// --spawn starts that many workers itself, more can join with bench worker at any time.
+// --leave n makes the first spawned worker (or this worker) leave after n items, as a crashing worker would.
+// --verify renders the image again without workers afterwards, any difference is a failure (exit code 1).
+
+#include "precomp.h"
+#include "bench.h"
+
+#ifdef __linux__
+
+struct DistributedOptions
+{
+	string host = "127.0.0.1";
+	string cache = "scene.cache";
+	int port = DISTRIBUTEDPORT;
+	unsigned spp = 64;
+	unsigned seed = 1234;
+	int spawn = 0;
+	unsigned leave = UINT_MAX;
+	bool verify = false;
+};
+
+static bool parseOptions( int argc, char **argv, DistributedOptions &options )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[i];
+		if ( arg == "--verify" )
+		{
+			options.verify = true;
+			continue;
+		}
+		if ( i + 1 >= argc )
+		{
+			return false;
+		}
+
+		if ( arg == "--host" ) options.host = argv[++i];
+		else if ( arg == "--cache" ) options.cache = argv[++i];
+		else if ( arg == "--port" ) options.port = atoi( argv[++i] );
+		else if ( arg == "--spp" ) options.spp = max( 1, atoi( argv[++i] ) );
+		else if ( arg == "--seed" ) options.seed = (unsigned)atoi( argv[++i] );
+		else if ( arg == "--spawn" ) options.spawn = max( 0, atoi( argv[++i] ) );
+		else if ( arg == "--leave" ) options.leave = (unsigned)atoi( argv[++i] );
+		else return false;
+	}
+	return true;
+}
+
+// Runs bench worker in a child process
+static pid_t spawnWorker( const DistributedOptions &options, bool leave )
+{
+	const string port = to_string( options.port ), items = to_string( options.leave );
+	const pid_t pid = fork();
+	if ( pid == 0 )
+	{
+		if ( leave )
+		{
+			execl( "/proc/self/exe", "bench", "worker", "--port", port.c_str(), "--leave", items.c_str(), (char *)nullptr );
+		}
+		else
+		{
+			execl( "/proc/self/exe", "bench", "worker", "--port", port.c_str(), (char *)nullptr );
+		}
+		_exit( 127 );
+	}
+	return pid;
+}
+
+// The same items as the coordinator, merged in the same order
+static bool verify( Renderer &distributed, const DistributedOptions &options )
+{
+	Renderer local( sphereScene() );
+	local.setCamera( *distributed.getCamera() );
+	local.setSeed( options.seed );
+
+	vector<vec3> sum;
+	for ( int tile = 0; tile < local.getTileCount(); tile++ )
+	{
+		int x0, y0, x1, y1;
+		local.getTileBounds( tile, x0, y0, x1, y1 );
+		sum.resize( ( x1 - x0 ) * ( y1 - y0 ) );
+
+		for ( unsigned first = 0; first < options.spp; first += DISTRIBUTEDITERATIONS )
+		{
+			const unsigned count = min( options.spp - first, (unsigned)DISTRIBUTEDITERATIONS );
+			local.renderTileSamples( tile, first, count, sum.data() );
+			local.addTileSamples( tile, count, sum.data() );
+		}
+	}
+
+	vector<vec3> expected( SCRWIDTH * SCRHEIGHT ), image( SCRWIDTH * SCRHEIGHT );
+	local.getRadiance( expected.data() );
+	distributed.getRadiance( image.data() );
+
+	int mismatches = 0;
+	for ( int i = 0; i < SCRWIDTH * SCRHEIGHT; i++ )
+	{
+		mismatches += image[i].x != expected[i].x || image[i].y != expected[i].y || image[i].z != expected[i].z;
+	}
+	printf( "verify: %d of %d pixels differ\n", mismatches, SCRWIDTH * SCRHEIGHT );
+	return mismatches == 0;
+}
+
+int runCoordinator( int argc, char **argv )
+{
+	DistributedOptions options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench coordinator [--port n] [--spp n] [--seed n] [--cache file] [--spawn n] [--leave n] [--verify]\n" );
+		return 2;
+	}
+
+	vector<Primitive *> scene = sphereScene();
+	if ( !saveSceneCache( options.cache.c_str(), scene ) )
+	{
+		fprintf( stderr, "could not write %s\n", options.cache.c_str() );
+		return 1;
+	}
+
+	Renderer renderer( scene );
+	renderer.setCamera( gameCamera() );
+	renderer.setSeed( options.seed );
+
+	Coordinator coordinator( renderer, options.cache, options.seed, options.spp );
+	if ( !coordinator.listen( options.port ) )
+	{
+		fprintf( stderr, "could not listen on port %d\n", options.port );
+		return 1;
+	}
+
+	vector<pid_t> children;
+	for ( int i = 0; i < options.spawn; i++ )
+	{
+		children.push_back( spawnWorker( options, i == 0 && options.leave != UINT_MAX ) );
+	}
+
+	timer total, report;
+	while ( coordinator.update( 100 ) )
+	{
+		if ( report.elapsed() >= 1000.f )
+		{
+			printf( "%5.1f%%  %d workers\n", coordinator.getProgress() * 100.f, coordinator.getWorkerCount() );
+			fflush( stdout );
+			report.reset();
+		}
+	}
+	printf( "%u spp in %.1f ms\n", options.spp, total.elapsed() );
+
+	for ( pid_t child : children )
+	{
+		waitpid( child, nullptr, 0 );
+	}
+
+	return options.verify && !verify( renderer, options ) ? 1 : 0;
+}
+
+int runWorkerMode( int argc, char **argv )
+{
+	DistributedOptions options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench worker [--host address] [--port n] [--leave n]\n" );
+		return 2;
+	}
+
+	if ( !runWorker( options.host.c_str(), options.port, options.leave ) )
+	{
+		fprintf( stderr, "worker: lost the coordinator at %s:%d\n", options.host.c_str(), options.port );
+		return 1;
+	}
+	return 0;
+}
+
+#else
+
+int runCoordinator( int, char ** )
+{
+	fprintf( stderr, "distributed rendering is Linux only\n" );
+	return 1;
+}
+
+int runWorkerMode( int, char ** )
+{
+	fprintf( stderr, "distributed rendering is Linux only\n" );
+	return 1;
+}
+
+#endif
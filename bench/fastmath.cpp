@@ -0,0 +1,231 @@
+// Accuracy and throughput of the approximations in FastMath.h against the C library
+// Usage: bench fastmath [--samples n]
+// The maximum absolute error of every form (scalar, SSE and AVX2 when compiled in) is measured against double
+// precision over the valid range and compared to the FASTMATH_*_ERROR bounds. Throughput is in ns per call,
+// a call of a SIMD form counts as one per lane. Returns 1 when a bound is exceeded.
+
+#include "precomp.h"
+#include "bench.h"
+
+#define LANES_SSE 4
+#define LANES_AVX2 8
+
+// Inputs of the three functions, a regular sweep plus the special points
+struct Inputs
+{
+	vector<float> angles; // fastSinCos, two sweeps: [-2 pi, 2 pi] and the whole valid range
+	vector<float> y, x;	  // fastAtan2, every direction at several magnitudes, axes and zeros included
+	vector<float> sines;  // fastAsin, [-1, 1]
+};
+
+static Inputs makeInputs( size_t samples )
+{
+	Inputs in;
+	const size_t half = samples / 2;
+
+	for ( size_t i = 0; i < half; i++ )
+	{
+		in.angles.push_back( -2.f * PI + 4.f * PI * float( i ) / float( half ) );
+		in.angles.push_back( -FASTMATH_SINCOS_RANGE + 2.f * FASTMATH_SINCOS_RANGE * float( i ) / float( half ) );
+	}
+
+	const float magnitudes[] = {1e-3f, 1.f, 1e3f};
+	for ( float m : magnitudes )
+	{
+		for ( size_t i = 0; i < samples / 3; i++ )
+		{
+			const double angle = -PI + 2.0 * PI * double( i ) / double( samples / 3 );
+			in.y.push_back( float( m * sin( angle ) ) );
+			in.x.push_back( float( m * cos( angle ) ) );
+		}
+	}
+
+	const float special[][2] = {{0.f, 1.f}, {0.f, -1.f}, {1.f, 0.f}, {-1.f, 0.f}, {0.f, 0.f}, {-0.f, -1.f}, {1.f, 1.f}, {-1.f, -1.f}};
+	for ( const float *p : special )
+	{
+		in.y.push_back( p[0] );
+		in.x.push_back( p[1] );
+	}
+
+	for ( size_t i = 0; i <= samples; i++ )
+	{
+		in.sines.push_back( -1.f + 2.f * float( i ) / float( samples ) );
+	}
+
+	// Whole SIMD batches
+	while ( in.angles.size() % LANES_AVX2 ) in.angles.push_back( 0.f );
+	while ( in.y.size() % LANES_AVX2 ) in.y.push_back( 0.f ), in.x.push_back( 1.f );
+	while ( in.sines.size() % LANES_AVX2 ) in.sines.push_back( 0.f );
+
+	return in;
+}
+
+// Evaluates a form into results, laid out as the inputs
+struct Results
+{
+	vector<float> sin, cos, atan2, asin;
+};
+
+static Results scalarForm( const Inputs &in )
+{
+	Results r;
+	r.sin.resize( in.angles.size() ), r.cos.resize( in.angles.size() ), r.atan2.resize( in.y.size() ), r.asin.resize( in.sines.size() );
+	for ( size_t i = 0; i < in.angles.size(); i++ ) fastSinCos( in.angles[i], r.sin[i], r.cos[i] );
+	for ( size_t i = 0; i < in.y.size(); i++ ) r.atan2[i] = fastAtan2( in.y[i], in.x[i] );
+	for ( size_t i = 0; i < in.sines.size(); i++ ) r.asin[i] = fastAsin( in.sines[i] );
+	return r;
+}
+
+static Results sseForm( const Inputs &in )
+{
+	Results r;
+	r.sin.resize( in.angles.size() ), r.cos.resize( in.angles.size() ), r.atan2.resize( in.y.size() ), r.asin.resize( in.sines.size() );
+	for ( size_t i = 0; i < in.angles.size(); i += LANES_SSE )
+	{
+		__m128 s, c;
+		fastSinCos( _mm_loadu_ps( &in.angles[i] ), s, c );
+		_mm_storeu_ps( &r.sin[i], s ), _mm_storeu_ps( &r.cos[i], c );
+	}
+	for ( size_t i = 0; i < in.y.size(); i += LANES_SSE ) _mm_storeu_ps( &r.atan2[i], fastAtan2( _mm_loadu_ps( &in.y[i] ), _mm_loadu_ps( &in.x[i] ) ) );
+	for ( size_t i = 0; i < in.sines.size(); i += LANES_SSE ) _mm_storeu_ps( &r.asin[i], fastAsin( _mm_loadu_ps( &in.sines[i] ) ) );
+	return r;
+}
+
+#ifdef __AVX2__
+static Results avx2Form( const Inputs &in )
+{
+	Results r;
+	r.sin.resize( in.angles.size() ), r.cos.resize( in.angles.size() ), r.atan2.resize( in.y.size() ), r.asin.resize( in.sines.size() );
+	for ( size_t i = 0; i < in.angles.size(); i += LANES_AVX2 )
+	{
+		__m256 s, c;
+		fastSinCos( _mm256_loadu_ps( &in.angles[i] ), s, c );
+		_mm256_storeu_ps( &r.sin[i], s ), _mm256_storeu_ps( &r.cos[i], c );
+	}
+	for ( size_t i = 0; i < in.y.size(); i += LANES_AVX2 ) _mm256_storeu_ps( &r.atan2[i], fastAtan2( _mm256_loadu_ps( &in.y[i] ), _mm256_loadu_ps( &in.x[i] ) ) );
+	for ( size_t i = 0; i < in.sines.size(); i += LANES_AVX2 ) _mm256_storeu_ps( &r.asin[i], fastAsin( _mm256_loadu_ps( &in.sines[i] ) ) );
+	return r;
+}
+#endif
+
+template <typename Reference>
+static double maxError( const vector<float> &results, Reference reference )
+{
+	double worst = 0.0;
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		worst = max( worst, fabs( double( results[i] ) - reference( i ) ) );
+	}
+	return worst;
+}
+
+// Prints the errors of a form, returns the number of bounds exceeded
+static int checkForm( const char *name, const Inputs &in, const Results &r )
+{
+	const double sinError = maxError( r.sin, [&]( size_t i ) { return sin( double( in.angles[i] ) ); } );
+	const double cosError = maxError( r.cos, [&]( size_t i ) { return cos( double( in.angles[i] ) ); } );
+	const double atan2Error = maxError( r.atan2, [&]( size_t i ) { return atan2( double( in.y[i] ), double( in.x[i] ) ); } );
+	const double asinError = maxError( r.asin, [&]( size_t i ) { return asin( double( in.sines[i] ) ); } );
+
+	const bool sinCosOk = max( sinError, cosError ) <= FASTMATH_SINCOS_ERROR;
+	const bool atan2Ok = atan2Error <= FASTMATH_ATAN2_ERROR;
+	const bool asinOk = asinError <= FASTMATH_ASIN_ERROR;
+
+	printf( "%-6s  sin %.2e  cos %.2e%s  atan2 %.2e%s  asin %.2e%s\n", name, sinError, cosError, sinCosOk ? "" : " EXCEEDED",
+			atan2Error, atan2Ok ? "" : " EXCEEDED", asinError, asinOk ? "" : " EXCEEDED" );
+
+	return !sinCosOk + !atan2Ok + !asinOk;
+}
+
+// ns per evaluation, fastest of three runs
+template <typename Kernel>
+static float nsPerCall( size_t calls, Kernel kernel )
+{
+	return fastest( 3, kernel ) * 1e6f / float( calls );
+}
+
+static void throughput( const Inputs &in )
+{
+	const size_t n = in.angles.size();
+	vector<float> s( n ), c( n );
+
+	const float libSinCos = nsPerCall( n, [&]() { for ( size_t i = 0; i < n; i++ ) s[i] = sinf( in.angles[i] ), c[i] = cosf( in.angles[i] ); } );
+	const float fastScalar = nsPerCall( n, [&]() { for ( size_t i = 0; i < n; i++ ) fastSinCos( in.angles[i], s[i], c[i] ); } );
+	const float fastSSE = nsPerCall( n, [&]() {
+		for ( size_t i = 0; i < n; i += LANES_SSE )
+		{
+			__m128 s4, c4;
+			fastSinCos( _mm_loadu_ps( &in.angles[i] ), s4, c4 );
+			_mm_storeu_ps( &s[i], s4 ), _mm_storeu_ps( &c[i], c4 );
+		}
+	} );
+	printf( "sincos  libm %6.2f  scalar %6.2f  sse %6.2f", libSinCos, fastScalar, fastSSE );
+#ifdef __AVX2__
+	const float fastAVX2 = nsPerCall( n, [&]() {
+		for ( size_t i = 0; i < n; i += LANES_AVX2 )
+		{
+			__m256 s8, c8;
+			fastSinCos( _mm256_loadu_ps( &in.angles[i] ), s8, c8 );
+			_mm256_storeu_ps( &s[i], s8 ), _mm256_storeu_ps( &c[i], c8 );
+		}
+	} );
+	printf( "  avx2 %6.2f", fastAVX2 );
+#endif
+	printf( " ns/call\n" );
+
+	const size_t m = in.y.size();
+	vector<float> a( m );
+	const float libAtan2 = nsPerCall( m, [&]() { for ( size_t i = 0; i < m; i++ ) a[i] = atan2f( in.y[i], in.x[i] ); } );
+	const float fastAtan2Scalar = nsPerCall( m, [&]() { for ( size_t i = 0; i < m; i++ ) a[i] = fastAtan2( in.y[i], in.x[i] ); } );
+	const float fastAtan2SSE = nsPerCall( m, [&]() { for ( size_t i = 0; i < m; i += LANES_SSE ) _mm_storeu_ps( &a[i], fastAtan2( _mm_loadu_ps( &in.y[i] ), _mm_loadu_ps( &in.x[i] ) ) ); } );
+	printf( "atan2   libm %6.2f  scalar %6.2f  sse %6.2f", libAtan2, fastAtan2Scalar, fastAtan2SSE );
+#ifdef __AVX2__
+	const float fastAtan2AVX2 = nsPerCall( m, [&]() { for ( size_t i = 0; i < m; i += LANES_AVX2 ) _mm256_storeu_ps( &a[i], fastAtan2( _mm256_loadu_ps( &in.y[i] ), _mm256_loadu_ps( &in.x[i] ) ) ); } );
+	printf( "  avx2 %6.2f", fastAtan2AVX2 );
+#endif
+	printf( " ns/call\n" );
+
+	const size_t k = in.sines.size();
+	vector<float> b( k );
+	const float libAsin = nsPerCall( k, [&]() { for ( size_t i = 0; i < k; i++ ) b[i] = asinf( in.sines[i] ); } );
+	const float fastAsinScalar = nsPerCall( k, [&]() { for ( size_t i = 0; i < k; i++ ) b[i] = fastAsin( in.sines[i] ); } );
+	const float fastAsinSSE = nsPerCall( k, [&]() { for ( size_t i = 0; i < k; i += LANES_SSE ) _mm_storeu_ps( &b[i], fastAsin( _mm_loadu_ps( &in.sines[i] ) ) ); } );
+	printf( "asin    libm %6.2f  scalar %6.2f  sse %6.2f", libAsin, fastAsinScalar, fastAsinSSE );
+#ifdef __AVX2__
+	const float fastAsinAVX2 = nsPerCall( k, [&]() { for ( size_t i = 0; i < k; i += LANES_AVX2 ) _mm256_storeu_ps( &b[i], fastAsin( _mm256_loadu_ps( &in.sines[i] ) ) ); } );
+	printf( "  avx2 %6.2f", fastAsinAVX2 );
+#endif
+	printf( " ns/call\n" );
+
+	sink = int( s[n / 3] + c[n / 5] + a[m / 3] + b[k / 3] );
+}
+
+int runFastMath( int argc, char **argv )
+{
+	size_t samples = 1 << 20;
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( string( argv[i] ) == "--samples" && i + 1 < argc )
+		{
+			samples = max( 16, atoi( argv[++i] ) );
+		}
+		else
+		{
+			fprintf( stderr, "usage: bench fastmath [--samples n]\n" );
+			return 2;
+		}
+	}
+
+	const Inputs in = makeInputs( samples );
+
+	printf( "maximum absolute error, bounds sincos %.1e atan2 %.1e asin %.1e\n", FASTMATH_SINCOS_ERROR, FASTMATH_ATAN2_ERROR, FASTMATH_ASIN_ERROR );
+	int exceeded = checkForm( "scalar", in, scalarForm( in ) );
+	exceeded += checkForm( "sse", in, sseForm( in ) );
+#ifdef __AVX2__
+	exceeded += checkForm( "avx2", in, avx2Form( in ) );
+#endif
+
+	throughput( in );
+
+	return exceeded > 0 ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+// Scalability of the BVH on procedural stress scenes, see SceneGenerator.h
+// Usage: bench scale [--scenes name,name,...] [--max n] [--sizes n,n,...] [--seed n] [--csv file.csv]
+// Sizes default to the powers of ten from 1000 up to --max (1000000), memory permitting up to 10^8 works.
+// Every scene and size adds a CSV row with build time, memory of primitives and BVH, and single thread rays/s.
+// Build time per primitive grows slowly for an O(n log n) builder, a jump of more than
+// SUPERLINEAR times per tenfold increase in size is flagged.
+
+#include "precomp.h"
+#include "bench.h"
+
+#define SUPERLINEAR 2.f
+
+struct ScaleOptions
+{
+	vector<StressScene> scenes;
+	vector<size_t> sizes;
+	size_t max = 1000000;
+	unsigned seed = 1234;
+	string csv = "scale.csv";
+};
+
+static vector<string> split( const string &list )
+{
+	vector<string> result;
+	stringstream stream( list );
+	string item;
+	while ( getline( stream, item, ',' ) )
+	{
+		result.push_back( item );
+	}
+	return result;
+}
+
+static bool parseOptions( int argc, char **argv, ScaleOptions &options )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[i];
+		if ( i + 1 >= argc )
+		{
+			return false;
+		}
+
+		if ( arg == "--max" ) options.max = (size_t)atof( argv[++i] );
+		else if ( arg == "--seed" ) options.seed = (unsigned)atoi( argv[++i] );
+		else if ( arg == "--csv" ) options.csv = argv[++i];
+		else if ( arg == "--sizes" )
+		{
+			for ( const string &size : split( argv[++i] ) )
+			{
+				options.sizes.push_back( (size_t)atof( size.c_str() ) );
+			}
+		}
+		else if ( arg == "--scenes" )
+		{
+			for ( const string &name : split( argv[++i] ) )
+			{
+				int type = 0;
+				while ( type < STRESS_SCENE_COUNT && name != stressSceneName( (StressScene)type ) )
+				{
+					type++;
+				}
+
+				if ( type == STRESS_SCENE_COUNT )
+				{
+					fprintf( stderr, "unknown scene %s\n", name.c_str() );
+					return false;
+				}
+				options.scenes.push_back( (StressScene)type );
+			}
+		}
+		else return false;
+	}
+
+	if ( options.scenes.empty() )
+	{
+		for ( int type = 0; type < STRESS_SCENE_COUNT; type++ )
+		{
+			options.scenes.push_back( (StressScene)type );
+		}
+	}
+
+	if ( options.sizes.empty() )
+	{
+		for ( size_t size = 1000; size <= options.max; size *= 10 )
+		{
+			options.sizes.push_back( size );
+		}
+	}
+
+	return true;
+}
+
+static size_t primitiveBytes( const vector<Primitive *> &primitives )
+{
+	size_t bytes = primitives.capacity() * sizeof( Primitive * );
+	for ( Primitive *p : primitives )
+	{
+		bytes += dynamic_cast<Sphere *>( p ) ? sizeof( Sphere ) : sizeof( Triangle );
+	}
+	return bytes;
+}
+
+// Million rays per second on one thread
+static float traceRate( const BVH &bvh, const vector<Ray> &rays )
+{
+	if ( rays.empty() )
+	{
+		return 0.f;
+	}
+
+	timer t;
+	int hits = 0;
+	for ( const Ray &r : rays )
+	{
+		hits += bvh.intersect( r ).hitType != 0;
+	}
+	sink = hits;
+
+	return float( rays.size() ) / ( max( t.elapsed(), 1e-3f ) * 1000.f );
+}
+
+static float occlusionRate( const BVH &bvh, const vector<Ray> &rays, const vector<float> &maxT )
+{
+	if ( rays.empty() )
+	{
+		return 0.f;
+	}
+
+	timer t;
+	int hits = 0, occluder;
+	for ( size_t i = 0; i < rays.size(); i++ )
+	{
+		hits += bvh.occluded( rays[i], maxT[i], -1, occluder );
+	}
+	sink = hits;
+
+	return float( rays.size() ) / ( max( t.elapsed(), 1e-3f ) * 1000.f );
+}
+
+int runScale( int argc, char **argv )
+{
+	ScaleOptions options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench scale [--scenes name,...] [--max n] [--sizes n,...] [--seed n] [--csv file.csv]\n" );
+		return 2;
+	}
+
+	Material mat;
+	mat.type = MaterialType::LAMBERTIAN_MAT;
+	mat.albedo = vec3( 0.5f, 0.5f, 0.5f );
+	mat.emission = vec3( 0.f, 0.f, 0.f );
+
+	ofstream csv( options.csv );
+	csv << "scene,primitives,build_ms,build_ns_per_primitive,primitive_mb,bvh_mb,primary_mrays,diffuse_mrays,shadow_mrays" << endl;
+
+	int flagged = 0;
+
+	for ( StressScene type : options.scenes )
+	{
+		float previousPerPrimitive = 0.f;
+		size_t previousCount = 0;
+
+		for ( size_t size : options.sizes )
+		{
+			vector<Primitive *> primitives = generateStressScene( type, size, options.seed, mat );
+			for ( size_t i = 0; i < primitives.size(); i++ )
+			{
+				primitives[i]->id = (int)i;
+			}
+
+			const aabb bounds = Tuning::sceneBounds( primitives );
+
+			timer t;
+			BVH bvh( primitives );
+			float buildTime = t.elapsed();
+
+			const RaySets sets = makeRaySets( bvh, bounds, nullptr, options.seed );
+			const float perPrimitive = buildTime * 1e6f / float( primitives.size() );
+			const float primitiveMB = primitiveBytes( primitives ) / ( 1024.f * 1024.f );
+			const float bvhMB = bvh.memoryUsage() / ( 1024.f * 1024.f );
+			const float primary = traceRate( bvh, sets.primary );
+			const float diffuse = traceRate( bvh, sets.diffuse );
+			const float shadow = occlusionRate( bvh, sets.shadow, sets.shadowT );
+
+			csv << stressSceneName( type ) << "," << primitives.size() << "," << buildTime << "," << perPrimitive << ","
+				<< primitiveMB << "," << bvhMB << "," << primary << "," << diffuse << "," << shadow << endl;
+
+			// Build time per primitive compared to the previous size, scaled to a tenfold increase
+			bool superLinear = false;
+			if ( previousCount > 0 && previousPerPrimitive > 0.f )
+			{
+				float decades = log10f( float( primitives.size() ) / float( previousCount ) );
+				superLinear = decades > 0.f && powf( perPrimitive / previousPerPrimitive, 1.f / decades ) > SUPERLINEAR;
+				flagged += superLinear;
+			}
+
+			printf( "%-20s %10zu prims  build %10.1f ms (%7.1f ns/prim)  %8.1f + %8.1f MB  %6.2f / %6.2f / %6.2f Mrays/s%s\n",
+					stressSceneName( type ), primitives.size(), buildTime, perPrimitive, primitiveMB, bvhMB, primary, diffuse, shadow,
+					superLinear ? "  SUPERLINEAR" : "" );
+			fflush( stdout );
+
+			previousPerPrimitive = perPrimitive;
+			previousCount = primitives.size();
+
+			for ( Primitive *p : primitives )
+			{
+				delete p;
+			}
+		}
+	}
+
+	return flagged > 0 ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+// Calibration of the constants in Tuning.h for this host, the result is applied by Game::Init on later runs
+// Usage: bench tune [--out file] [--size n] [--frames n] [--seed n]
+// 1. The cost of a traversal step (two bounds tests) relative to a primitive intersection, which is the
+//    traversal cost of the SAH of scenes without their own parameters.
+// 2. Bin count, leaf size and depth of the BVH per scene: the Game::Init scene, and a terrain and a mesh
+//    grid of --size primitives. The score is the time to trace the ray sets of bench.h plus the build
+//    time spread over --frames frames.
+// 3. Tile size and thread count, by rendering --frames frames of the Game::Init scene with every pair.
+// The profile is written to --out (TUNINGFILE).
+
+#include "precomp.h"
+#include "bench.h"
+
+#define TUNE_REPEAT 3 // The fastest of this many runs counts
+
+struct TuneOptions
+{
+	string out = TUNINGFILE;
+	size_t size = 100000;
+	unsigned frames = 32;
+	unsigned seed = 1234;
+};
+
+static bool parseOptions( int argc, char **argv, TuneOptions &options )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[i];
+		if ( i + 1 >= argc )
+		{
+			return false;
+		}
+
+		if ( arg == "--out" ) options.out = argv[++i];
+		else if ( arg == "--size" ) options.size = (size_t)atof( argv[++i] );
+		else if ( arg == "--frames" ) options.frames = max( 1, atoi( argv[++i] ) );
+		else if ( arg == "--seed" ) options.seed = (unsigned)atoi( argv[++i] );
+		else return false;
+	}
+	return true;
+}
+
+// Two bounds tests per primitive intersection, measured on the primary rays of a terrain
+static float measureTraversalCost( const vector<Primitive *> &primitives, const RaySets &sets )
+{
+	const size_t testCount = min( primitives.size(), (size_t)32 );
+	vector<aabb> testBounds;
+	for ( size_t i = 0; i < testCount; i++ )
+	{
+		testBounds.push_back( primitives[i]->volume() );
+	}
+
+	const float hit = fastest( TUNE_REPEAT, [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.primary )
+			for ( size_t i = 0; i < testCount; i++ ) hits += primitives[i]->hit( r ).hitType != 0;
+		sink = hits;
+	} );
+
+	const float bounds = fastest( TUNE_REPEAT, [&]() {
+		int hits = 0;
+		for ( const Ray &r : sets.primary )
+			for ( const aabb &b : testBounds ) hits += BVHNode::rayIntersectsBounds( b, r );
+		sink = hits;
+	} );
+
+	return hit > 0.f ? 2.f * bounds / hit : TRAVERSALCOST;
+}
+
+// Trace time of the ray sets plus the build time spread over the frames, in ms
+static float bvhScore( const vector<Primitive *> &primitives, const BVHParameters &parameters, const aabb &bounds, const Camera *view, const TuneOptions &options )
+{
+	timer t;
+	const BVH bvh( primitives, parameters );
+	const float build = t.elapsed();
+
+	const RaySets sets = makeRaySets( bvh, bounds, view, options.seed );
+
+	const float trace = fastest( TUNE_REPEAT, [&]() {
+		int hits = 0, occluder;
+		for ( const Ray &r : sets.primary ) hits += bvh.intersect( r ).hitType != 0;
+		for ( const Ray &r : sets.diffuse ) hits += bvh.intersect( r ).hitType != 0;
+		for ( size_t i = 0; i < sets.shadow.size(); i++ ) hits += bvh.occluded( sets.shadow[i], sets.shadowT[i], -1, occluder );
+		sink = hits;
+	} );
+
+	return trace + build / options.frames;
+}
+
+static BVHParameters tuneBVH( const char *name, const vector<Primitive *> &primitives, const Camera *view, float traversalCost, const TuneOptions &options )
+{
+	const aabb bounds = Tuning::sceneBounds( primitives );
+
+	BVHParameters best;
+	best.traversalCost = traversalCost;
+	float bestScore = bvhScore( primitives, best, bounds, view, options );
+	const float defaultScore = bestScore;
+
+	for ( int binCount : {8, 16, 32} )
+	{
+		for ( int leafSize : {1, 2, 3, 4, 8, 16} )
+		{
+			BVHParameters candidate = best;
+			candidate.binCount = binCount;
+			candidate.leafSize = leafSize;
+
+			const float score = bvhScore( primitives, candidate, bounds, view, options );
+			if ( score < bestScore )
+			{
+				best = candidate, bestScore = score;
+			}
+		}
+	}
+
+	// The depth limit only matters for deep trees, so it is tried with the best of the others
+	for ( int maxDepth : {32, 64} )
+	{
+		BVHParameters candidate = best;
+		candidate.maxDepth = maxDepth;
+
+		const float score = bvhScore( primitives, candidate, bounds, view, options );
+		if ( score < bestScore )
+		{
+			best = candidate, bestScore = score;
+		}
+	}
+
+	printf( "%-12s %8zu prims  bins %2d  leaf %d  depth %3d  %8.2f ms (defaults %8.2f ms)\n", name, primitives.size(), best.binCount, best.leafSize,
+			best.maxDepth, bestScore, defaultScore );
+	fflush( stdout );
+	return best;
+}
+
+// Milliseconds for the frames of the Game::Init scene
+static float renderTime( unsigned tileSize, int threads, const TuneOptions &options )
+{
+	tuning.tileSize = tileSize;
+#ifdef _OPENMP
+	omp_set_num_threads( threads );
+#else
+	(void)threads; // Always 1
+#endif
+
+	Renderer renderer( sphereScene() );
+	renderer.setCamera( gameCamera() );
+	renderer.setSeed( options.seed );
+	renderer.renderFrame(); // Scene setup
+
+	timer t;
+	for ( unsigned i = 0; i < options.frames; i++ )
+	{
+		renderer.renderFrame();
+	}
+	return t.elapsed();
+}
+
+int runTune( int argc, char **argv )
+{
+	TuneOptions options;
+	if ( !parseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: bench tune [--out file] [--size n] [--frames n] [--seed n]\n" );
+		return 2;
+	}
+
+	Material mat;
+	mat.type = MaterialType::LAMBERTIAN_MAT;
+	mat.albedo = vec3( 0.5f, 0.5f, 0.5f );
+	mat.emission = vec3( 0.f, 0.f, 0.f );
+
+	Tuning profile;
+
+	// Traversal step against intersection
+	{
+		vector<Primitive *> terrain = generateStressScene( TERRAIN, options.size, options.seed, mat );
+		const BVH bvh( terrain );
+		profile.traversalCost = measureTraversalCost( terrain, makeRaySets( bvh, Tuning::sceneBounds( terrain ), nullptr, options.seed ) );
+		printf( "traversal step costs %.3f intersections\n", profile.traversalCost );
+
+		for ( Primitive *p : terrain )
+		{
+			delete p;
+		}
+	}
+
+	// BVH parameters per scene
+	{
+		vector<Primitive *> game = sphereScene();
+		const Camera camera = gameCamera();
+		profile.setScene( Tuning::sceneKey( game ), tuneBVH( "game", game, &camera, profile.traversalCost, options ) );
+		for ( Primitive *p : game )
+		{
+			delete p;
+		}
+	}
+
+	for ( StressScene type : {TERRAIN, MESH_GRID} )
+	{
+		vector<Primitive *> primitives = generateStressScene( type, options.size, options.seed, mat );
+		for ( size_t i = 0; i < primitives.size(); i++ )
+		{
+			primitives[i]->id = (int)i;
+		}
+
+		profile.setScene( Tuning::sceneKey( primitives ), tuneBVH( stressSceneName( type ), primitives, nullptr, profile.traversalCost, options ) );
+		for ( Primitive *p : primitives )
+		{
+			delete p;
+		}
+	}
+
+	// Tile size and threads, with the BVH parameters found above
+	tuning = profile;
+#ifdef _OPENMP
+	const int processors = min( omp_get_num_procs(), MAXTHREADS );
+#else
+	const int processors = 1;
+#endif
+	float bestTime = FLT_MAX;
+
+	for ( unsigned tileSize : {16u, 32u, 64u, 128u} )
+	{
+		for ( int threads = 1;; threads = min( threads * 2, processors ) )
+		{
+			const float time = renderTime( tileSize, threads, options );
+			printf( "tiles %3u  threads %2d  %8.1f ms\n", tileSize, threads, time );
+			fflush( stdout );
+
+			if ( time < bestTime )
+			{
+				profile.tileSize = tileSize, profile.threads = threads, bestTime = time;
+			}
+
+			if ( threads == processors )
+			{
+				break;
+			}
+		}
+	}
+
+	tuning = profile;
+	if ( !profile.save( options.out.c_str() ) )
+	{
+		fprintf( stderr, "could not write %s\n", options.out.c_str() );
+		return 1;
+	}
+
+	printf( "%s: %u pixel tiles, %d threads\n", options.out.c_str(), profile.tileSize, profile.threads );
+	return 0;
+}
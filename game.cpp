@@ -4,11 +4,42 @@ Renderer *renderer;
 int noPrim;
 int noLight;
 
+// --record file: write the input of every frame to file at shutdown
+// --replay file: render the recorded frames again, then report frame times and quit
+// --seed n: seed of the renderer while recording, random otherwise
+string recordFile;
+string replayFile;
+unsigned renderSeed = random_device()();
+InputRecording recording;
+size_t replayFrame = 0;
+vector<pair<int, int>> mouseMoves;
+vector<float> frameTimes;
+float cameraDrift = 0.f;
+
+void Game::SetArguments( int argc, char **argv )
+{
+	for ( int i = 1; i + 1 < argc; i += 2 )
+	{
+		string arg = argv[i];
+		if ( arg == "--record" ) recordFile = argv[i + 1];
+		else if ( arg == "--replay" ) replayFile = argv[i + 1];
+		else if ( arg == "--seed" ) renderSeed = (unsigned)atoi( argv[i + 1] );
+		else printf( "unknown argument %s\n", argv[i] );
+	}
+}
+
 // -----------------------------------------------------------
 // Initialize the application
 // -----------------------------------------------------------
 void Game::Init()
 {
+	// Tile size, threads and BVH parameters of an earlier bench tune on this host
+	if ( tuning.load( TUNINGFILE ) )
+	{
+		tuning.apply();
+		printf( "using %s: %u pixel tiles, %d threads\n", TUNINGFILE, tuning.tileSize, tuning.threads );
+	}
+
 	Camera cam = Camera( vec3( 0.f, 0.f, -2.f ), vec3( 0.f, 0.f, 0.f ), vec3( 0.f, 1.f, 0.f ), PI / 4, ( (float)SCRWIDTH / (float)SCRHEIGHT ), 0.f, 0.5f, 1.f );
 
 	Material mat;
@@ -48,9 +79,29 @@ void Game::Init()
 
 	renderer = new Renderer( scene );
 	noPrim = scene.size();
-	noLight = 1; // lights.size();
+	noLight = renderer->getLightCount();
 	renderer->setCamera( cam );
 	// renderer->setLights( lights );
+
+	if ( !replayFile.empty() )
+	{
+		if ( recording.load( replayFile.c_str() ) )
+		{
+			printf( "replaying %zu frames from %s\n", recording.frames.size(), replayFile.c_str() );
+			renderSeed = recording.seed;
+		}
+		else
+		{
+			printf( "could not read %s\n", replayFile.c_str() );
+			replayFile.clear();
+		}
+	}
+
+	if ( !recordFile.empty() || !replayFile.empty() )
+	{
+		recording.seed = renderSeed;
+		renderer->setSeed( renderSeed );
+	}
 }
 
 // -----------------------------------------------------------
@@ -58,9 +109,16 @@ void Game::Init()
 // -----------------------------------------------------------
 void Game::Shutdown()
 {
+	if ( !recordFile.empty() && !recording.save( recordFile.c_str() ) )
+	{
+		printf( "could not write %s\n", recordFile.c_str() );
+	}
+
 	delete renderer;
 }
 
+constexpr float rot_speed = 0.005f;
+
 bool showHelp = false;
 
 bool moveLeft = false;
@@ -83,11 +141,149 @@ bool zoomOut = false;
 bool apertureUp = false;
 bool apertureDown = false;
 
+// Dragging with the right button selects the region the renderer is cropped to, a click renders the whole frame
+bool selectingCrop = false;
+int cropStartX, cropStartY;
+
+// Bit i of InputFrame::keys
+bool *keyFlags[] = {&moveLeft, &moveRight, &moveUp, &moveDown, &moveForward, &moveBackward,
+					&rotLeft, &rotRight, &rotUp, &rotDown, &rotCW, &rotCCW,
+					&focusCam, &zoomIn, &zoomOut, &apertureUp, &apertureDown};
+
+uint packKeys()
+{
+	uint keys = 0;
+	for ( size_t i = 0; i < sizeof( keyFlags ) / sizeof( keyFlags[0] ); i++ )
+	{
+		keys |= uint( *keyFlags[i] ) << i;
+	}
+	return keys;
+}
+
+void unpackKeys( uint keys )
+{
+	for ( size_t i = 0; i < sizeof( keyFlags ) / sizeof( keyFlags[0] ); i++ )
+	{
+		*keyFlags[i] = ( keys >> i ) & 1;
+	}
+}
+
+float cameraDistance( const Camera &a, const Camera &b )
+{
+	return max( max( ( a.origin - b.origin ).length(), ( a.forward - b.forward ).length() ), max( ( a.up - b.up ).length(), ( a.right - b.right ).length() ) );
+}
+
+// The first press starts a capture, the second one writes it to trace.json
+void toggleProfiler()
+{
+	if ( !profiler.isCapturing() )
+	{
+		profiler.start();
+		printf( "profiling, press P again to write trace.json\n" );
+	}
+	else
+	{
+		profiler.stop();
+		printf( profiler.exportTrace( "trace.json" ) ? "wrote trace.json\n" : "could not write trace.json\n" );
+	}
+}
+
+// Render times of the last HUDWINDOW frames that rendered an iteration
+deque<float> frameWindow;
+float lastRenderTime = 0.f;
+
+void printPerformance( Surface *screen, float fps, float outputTime )
+{
+	const vector<float> window( frameWindow.begin(), frameWindow.end() );
+	const Statistics &stats = renderer->getStatistics();
+	char line[128];
+
+	snprintf( line, sizeof( line ), "FPS: %.1f, frame p50 %.1f p95 %.1f p99 %.1f ms", fps, percentile( window, 50.f ), percentile( window, 95.f ), percentile( window, 99.f ) );
+	screen->Print( line, 2, 2, 0xFFFFFF );
+
+	// Rays of the last rendered iteration, over its render time
+	const float us = max( lastRenderTime, 1e-3f ) * 1000.f;
+	snprintf( line, sizeof( line ), "Mrays/s: primary %.2f, diffuse %.2f, shadow %.2f", stats.get( STAT_PRIMARY_RAYS ) / us,
+			  stats.get( STAT_DIFFUSE_RAYS ) / us, stats.get( STAT_SHADOW_RAYS ) / us );
+	screen->Print( line, 2, 10, 0xFFFFFF );
+
+	snprintf( line, sizeof( line ), "Stages: scene %.2f, raster %.2f, tiles %.2f, output %.2f ms", stats.get( STAT_SCENE_US ) / 1000.f,
+			  stats.get( STAT_RASTER_US ) / 1000.f, stats.get( STAT_TILES_US ) / 1000.f, outputTime );
+	screen->Print( line, 2, 18, 0xFFFFFF );
+
+	// Converged once the renderer stops at its maximum iteration count
+	const unsigned spp = renderer->getIteration(), maxSpp = renderer->getMaxIterations();
+	if ( spp < maxSpp )
+	{
+		float mean = 0.f;
+		for ( float time : window )
+		{
+			mean += time / window.size();
+		}
+		snprintf( line, sizeof( line ), "spp: %u / %u, converged in %.1f s", spp, maxSpp, mean * ( maxSpp - spp ) / 1000.f );
+	}
+	else
+	{
+		snprintf( line, sizeof( line ), "spp: %u, converged", spp );
+	}
+	screen->Print( line, 2, 26, 0xFFFFFF );
+
+	// Hardware counters of the last rendered iteration, toggled with C
+	if ( perfCounters.isCounting() )
+	{
+		const PerfSample &tiles = perfCounters.get( PERF_SHADE ), &resolve = perfCounters.get( PERF_RESOLVE );
+		if ( !perfCounters.isAvailable() )
+		{
+			snprintf( line, sizeof( line ), "Hardware counters unavailable" );
+		}
+		else
+		{
+			snprintf( line, sizeof( line ), "Tiles: IPC %.2f, MPKI cache %.2f, branch %.2f. Output: IPC %.2f", tiles.ipc(),
+					  tiles.mpki( PERF_CACHE_MISSES ), tiles.mpki( PERF_BRANCH_MISSES ), resolve.ipc() );
+		}
+		screen->Print( line, 2, 34, 0xFFFFFF );
+	}
+}
+
+void finishReplay()
+{
+	printf( "replayed %zu frames, camera drift %g\n", frameTimes.size(), cameraDrift );
+	printf( "frame time p50 %.2f p90 %.2f p95 %.2f p99 %.2f max %.2f ms\n", percentile( frameTimes, 50.f ), percentile( frameTimes, 90.f ),
+			percentile( frameTimes, 95.f ), percentile( frameTimes, 99.f ), percentile( frameTimes, 100.f ) );
+
+	SDL_Event quit;
+	quit.type = SDL_QUIT;
+	SDL_PushEvent( &quit );
+}
+
 // -----------------------------------------------------------
 // Main application tick function
 // -----------------------------------------------------------
 void Game::Tick( float deltaTime )
 {
+	PROFILE_SCOPE( "Tick" );
+
+	// The recorded input replaces the live input
+	const InputFrame *replay = nullptr;
+	if ( !replayFile.empty() )
+	{
+		if ( replayFrame >= recording.frames.size() )
+		{
+			if ( replayFrame++ == recording.frames.size() )
+			{
+				finishReplay();
+			}
+			return;
+		}
+
+		replay = &recording.frames[replayFrame++];
+		for ( const pair<int, int> &m : replay->mouseMoves )
+		{
+			renderer->rotateCam( vec3( -m.first * rot_speed, m.second * rot_speed, 0.f ) );
+		}
+		unpackKeys( replay->keys );
+	}
+
 	// Handle input
 	if ( moveLeft )
 	{
@@ -178,17 +374,59 @@ void Game::Tick( float deltaTime )
 	screen->Clear( 0 );   /// I COMMENTED THAT OUT
 
 	// Render the frame
+	const unsigned iteration = renderer->getIteration();
 	timer t = timer();
 	renderer->renderFrame();
 	float elapsed = t.elapsed();
 	float fps = 1 / ( elapsed / 1000 );
 
+	// Idle frames only wait, they would skew the statistics
+	if ( renderer->getIteration() != iteration )
+	{
+		lastRenderTime = elapsed;
+		frameWindow.push_back( elapsed );
+		if ( frameWindow.size() > HUDWINDOW )
+		{
+			frameWindow.pop_front();
+		}
+	}
+
+	if ( replay )
+	{
+		frameTimes.push_back( elapsed );
+		cameraDrift = max( cameraDrift, cameraDistance( *renderer->getCamera(), replay->camera ) );
+	}
+	else if ( !recordFile.empty() )
+	{
+		InputFrame frame;
+		frame.deltaTime = deltaTime;
+		frame.keys = packKeys();
+		frame.mouseMoves.swap( mouseMoves );
+		frame.camera = *renderer->getCamera();
+		recording.frames.push_back( frame );
+	}
+
 	// Display
+	timer output = timer();
 	screen->SetBuffer( renderer->getOutput() );
+	float outputTime = output.elapsed();
+
+	// The crop, or the one being selected
+	int cropX0, cropY0, cropX1, cropY1;
+	if ( selectingCrop )
+	{
+		SDL_GetMouseState( &cropX1, &cropY1 );
+		screen->Box( min( cropStartX, cropX1 ), min( cropStartY, cropY1 ), max( cropStartX, cropX1 ), max( cropStartY, cropY1 ), 0xFFFF00 );
+	}
+	else if ( renderer->getCrop( cropX0, cropY0, cropX1, cropY1 ) )
+	{
+		screen->Box( cropX0, cropY0, cropX1 - 1, cropY1 - 1, 0xFFFF00 );
+	}
+
 	if ( !showHelp )
 	{
-		screen->Print( ( "FPS: " + to_string( fps ) ).c_str(), 2, 2, 0xFFFFFF );
-		screen->Print( "Press \"h\" for controls", 2, 10, 0xFFFFFF );
+		printPerformance( screen, fps, outputTime );
+		screen->Print( "Press \"h\" for controls", 2, perfCounters.isCounting() ? 42 : 34, 0xFFFFFF );
 	}
 	else
 	{
@@ -207,17 +445,72 @@ void Game::Tick( float deltaTime )
 		screen->Print( "G - Zoom out\n", 2, 98, 0xFFFFFF );
 		screen->Print( "Z - Aperture increase\n", 2, 106, 0xFFFFFF );
 		screen->Print( "X - Aperture decrease\n", 2, 114, 0xFFFFFF );
+		screen->Print( "P - Start / stop profiling to trace.json\n", 2, 122, 0xFFFFFF );
+		screen->Print( "C - Start / stop hardware counters\n", 2, 130, 0xFFFFFF );
+		screen->Print( "Right drag - Render only a region, right click - whole frame\n", 2, 138, 0xFFFFFF );
 		screen->Print( "X", SCRWIDTH / 2, SCRHEIGHT / 2, 0xFFFFFF );
 		screen->Print( ( "Aperture: " + to_string( renderer->getCamera()->aperture ) ).c_str(), 2, SCRHEIGHT - 24, 0xFFFFFF );
 		screen->Print( ( "Focal Length: " + to_string( renderer->getCamera()->focalLength ) ).c_str(), 2, SCRHEIGHT - 16, 0xFFFFFF );
 		screen->Print( ( "Focus Distance: " + to_string( renderer->getCamera()->focusDistance ) ).c_str(), 2, SCRHEIGHT - 8, 0xFFFFFF );
+
+		// Current ( peak ) MB per memory category, over two lines
+		string memory[2] = {"Memory MB:", ""};
+		for ( int c = 0; c < MEM_CATEGORY_COUNT; c++ )
+		{
+			char category[64];
+			snprintf( category, sizeof( category ), " %s %.1f (%.1f)", MemoryTracker::categoryName( (MemoryCategory)c ),
+					  memoryTracker.current( (MemoryCategory)c ) / 1048576.f, memoryTracker.peak( (MemoryCategory)c ) / 1048576.f );
+			memory[c * 2 / MEM_CATEGORY_COUNT] += category;
+		}
+		screen->Print( memory[0].c_str(), 2, SCRHEIGHT - 48, 0xFFFFFF );
+		screen->Print( ( memory[1] + ", total " + to_string( memoryTracker.total() / 1048576 ) ).c_str(), 2, SCRHEIGHT - 40, 0xFFFFFF );
+
+		const Statistics &stats = renderer->getStatistics();
+		screen->Print( ( "Shadow rays: " + to_string( stats.get( STAT_SHADOW_RAYS ) ) + ", occluder cache hits: " + to_string( int( stats.ratio( STAT_OCCLUDER_CACHE_HITS, STAT_SHADOW_RAYS ) * 100.f ) ) + "%" ).c_str(), 2, SCRHEIGHT - 32, 0xFFFFFF );
 	}
 }
 
-constexpr float rot_speed = 0.005f;
+void Tmpl8::Game::MouseDown( int button )
+{
+	if ( button == SDL_BUTTON_RIGHT )
+	{
+		SDL_GetMouseState( &cropStartX, &cropStartY );
+		selectingCrop = true;
+	}
+}
+
+void Tmpl8::Game::MouseUp( int button )
+{
+	if ( button != SDL_BUTTON_RIGHT || !selectingCrop )
+	{
+		return;
+	}
+
+	int x, y;
+	SDL_GetMouseState( &x, &y );
+	selectingCrop = false;
+
+	// Too small for a region, so a click
+	if ( abs( x - cropStartX ) < 4 || abs( y - cropStartY ) < 4 )
+	{
+		renderer->setCrop( 0, 0, 0, 0 );
+		return;
+	}
+
+	renderer->setCrop( min( x, cropStartX ), min( y, cropStartY ), max( x, cropStartX ), max( y, cropStartY ) );
+}
 
 void Tmpl8::Game::MouseMove( int x, int y )
 {
+	if ( !replayFile.empty() || selectingCrop )
+	{
+		return;
+	}
+
+	if ( !recordFile.empty() )
+	{
+		mouseMoves.push_back( make_pair( x, y ) );
+	}
 	renderer->rotateCam( vec3( -x * rot_speed, y * rot_speed, 0.f ) );
 }
 
@@ -306,6 +599,12 @@ void Tmpl8::Game::KeyDown( int key )
 	case SDL_SCANCODE_H:
 		showHelp = !showHelp;
 		break;
+	case SDL_SCANCODE_P:
+		toggleProfiler();
+		break;
+	case SDL_SCANCODE_C:
+		perfCounters.isCounting() ? perfCounters.stop() : perfCounters.start();
+		break;
 	case SDL_SCANCODE_LEFT:
 		rotLeft = true;
 		break;
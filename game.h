@@ -6,11 +6,12 @@ class Game
 {
 public:
 	void SetTarget( Surface* surface ) { screen = surface; }
+	void SetArguments( int argc, char** argv );
 	void Init();
 	void Shutdown();
 	void Tick( float deltaTime );
-	void MouseUp( int button ) { /* implement if you want to detect mouse button presses */ }
-	void MouseDown( int button ) { /* implement if you want to detect mouse button presses */ }
+	void MouseUp( int button );
+	void MouseDown( int button );
 	void MouseMove( int x, int y );
 	void KeyUp( int key );
 	void KeyDown( int key );
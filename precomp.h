@@ -8,6 +8,7 @@
 #define NOMINMAX
 
 #define MAX_IDLE_FPS 60.f
+#define HUDWINDOW 120 // Rendered frames the frame time percentiles of the HUD are taken over
 
 #define SCRWIDTH 512
 #define SCRHEIGHT 512
@@ -19,6 +20,35 @@
 //#define BVH_DEBUG
 #define BVHDEPTH 128
 #define BINCOUNT 16 // this can also be reduced for faster construction
+#define LEAFSIZE 3 // Nodes with fewer primitives are not split
+#define TRAVERSALCOST 0.f // SAH cost of a traversal step relative to an intersection, 0 splits for any gain
+#define TUNINGFILE "tuning.txt" // Written by bench tune, overrides the constants above when present
+
+#define PRIMARY_CACHE // Reuse primary hits while a pinhole camera is static
+#define PRIMARYCACHESIZE 4 // Number of jittered primary hits kept per pixel
+#define RASTERIZE_PRIMARY // Rasterize primary hits for pinhole cameras in triangle-only scenes
+#define TILE_COST_BALANCE // Give every thread a run of tiles of equal cost, timed in the previous iteration
+#define FOVEATION // Extra samples around the focus point (the crosshair) in the first iterations after a reset
+#define FOVEARADIUS 0.25f // Of the screen height
+#define FOVEASAMPLES 4 // Samples per iteration at the focus point, falling off to 1 at the radius
+#define FOVEAITERATIONS 16 // After this many iterations every pixel gets one sample per iteration again
+
+#define DIRECT_LIGHTING // Sample emissive primitives with shadow rays instead of waiting for diffuse rays to hit them
+//#define SORT_BY_MATERIAL // Trace the primary rays of a tile first, then shade the hits grouped by material (gain within noise)
+#define OCCLUDER_CACHE // Test the last occluder of a light on this thread before traversing the BVH
+
+#define CHANGEHISTORY 16 // Scene versions a snapshot remembers the changes of, for selective accumulation resets
+#define QUERYBATCH 64 // Rays per work item of a batched scene query
+#define DISTRIBUTEDITERATIONS 8 // Iterations of one tile per work item of a distributed render
+#define DISTRIBUTEDPORT 7878 // Default port of the coordinator of a distributed render
+#define DISTRIBUTEDTIMEOUT 60 // Seconds a worker may take to answer, after that it is dropped and its item requeued
+
+#define MAXTHREADS 64 // Per-thread storage, such as statistics, is sized for this many threads
+
+#define PROFILING // Compile in the scoped timers, they only record after Profiler::start()
+#define PROFILEEVENTS 8192 // Events kept per thread, older ones are overwritten
+#define PROFILESTRIDE 8 // Accumulated counters time one in this many scopes and scale up the result
+#define PERF_COUNTERS // Compile in the hardware counter scopes, they only count after PerfCounters::start()
 
 #define MAXRAYDEPTH 8
 #define SAMPLES 4
@@ -52,17 +82,39 @@
 #include <io.h>
 #endif
 
+#ifdef __linux__
+// Hardware performance counters
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Sockets of distributed rendering
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+
 // External dependencies:
 #include <FreeImage.h>
 #include <SDL2/SDL.h>
 
 // C++ headers
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <random>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -71,11 +123,17 @@
 
 // Namespaced C headers:
 #include <cassert>
+#include <cerrno>
 #include <cinttypes>
+#include <climits>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // Header for AVX, and every technology before it.
 // If your CPU does not support this, include the appropriate header instead.
 // See: https://stackoverflow.com/a/11228864/2844473
@@ -92,16 +150,30 @@ using namespace std;
 
 using namespace Tmpl8;
 
+#include "SIMD.h"
+#include "FastMath.h"
+#include "PerThread.h"
+#include "Statistics.h"
+#include "Profiler.h"
+#include "PerfCounters.h"
+#include "MemoryTracker.h"
 #include "Color.h"
 #include "Material.h"
 #include "Light.h"
 #include "Ray.h"
 #include "Camera.h"
+#include "InputRecording.h"
 #include "Primitive.h"
 #include "OBJLoader.h"
+#include "SceneGenerator.h"
+#include "Tuning.h"
 #include "BVH.h"
+#include "Scene.h"
+#include "Rasterizer.h"
+#include "SceneQuery.h"
 #include "Sample.h"
 #include "Renderer.h"
+#include "Distributed.h"
 
 #include "game.h"
 // clang-format on
@@ -17,11 +17,6 @@ namespace Tmpl8 {
 
 // Math Stuff
 // ----------------------------------------------------------------------------
-vec3 normalize( const vec3& v ) { return v.normalized(); }
-vec3 cross( const vec3& a, const vec3& b ) { return a.cross( b ); }
-float dot( const vec3& a, const vec3& b ) { return a.dot( b ); }
-vec3 operator * ( const float& s, const vec3& v ) { return vec3( v.x * s, v.y * s, v.z * s ); }
-vec3 operator * ( const vec3& v, const float& s ) { return vec3( v.x * s, v.y * s, v.z * s ); }
 vec4 operator * ( const float& s, const vec4& v ) { return vec4( v.x * s, v.y * s, v.z * s, v.w * s ); }
 vec4 operator * ( const vec4& v, const float& s ) { return vec4( v.x * s, v.y * s, v.z * s, v.w * s ); }
 mat4 operator * ( const mat4& a, const mat4& b )
@@ -97,6 +92,9 @@ void NotifyUser( const char *s )
 }
 }
 
+// Tools like the benchmarks link everything above, but bring their own main()
+#ifndef HEADLESS
+
 using namespace Tmpl8;
 using namespace std;
 
@@ -267,6 +265,7 @@ int main( int argc, char **argv )
 #endif
 	int exitapp = 0;
 	game = new Game();
+	game->SetArguments( argc, argv );
 	game->SetTarget( surface );
 	timer t;
 	t.reset();
@@ -276,25 +275,28 @@ int main( int argc, char **argv )
 		swap();
 		surface->SetBuffer( (Pixel*)framedata );
 	#else
-		void* target = 0;
-		int pitch;
-		SDL_LockTexture( frameBuffer, NULL, &target, &pitch );
-		if (pitch == (surface->GetWidth() * 4))
-		{
-			memcpy( target, surface->GetBuffer(), SCRWIDTH * SCRHEIGHT * 4 );
-		}
-		else
 		{
-			unsigned char* t = (unsigned char*)target;
-			for( int i = 0; i < SCRHEIGHT; i++ )
+			PROFILE_SCOPE( "present" );
+			void* target = 0;
+			int pitch;
+			SDL_LockTexture( frameBuffer, NULL, &target, &pitch );
+			if (pitch == (surface->GetWidth() * 4))
+			{
+				memcpy( target, surface->GetBuffer(), SCRWIDTH * SCRHEIGHT * 4 );
+			}
+			else
 			{
-				memcpy( t, surface->GetBuffer() + i * SCRWIDTH, SCRWIDTH * 4 );
-				t += pitch;
+				unsigned char* t = (unsigned char*)target;
+				for( int i = 0; i < SCRHEIGHT; i++ )
+				{
+					memcpy( t, surface->GetBuffer() + i * SCRWIDTH, SCRWIDTH * 4 );
+					t += pitch;
+				}
 			}
+			SDL_UnlockTexture( frameBuffer );
+			SDL_RenderCopy( renderer, frameBuffer, NULL, NULL );
+			SDL_RenderPresent( renderer );
 		}
-		SDL_UnlockTexture( frameBuffer );
-		SDL_RenderCopy( renderer, frameBuffer, NULL, NULL );
-		SDL_RenderPresent( renderer );
 	#endif
 		if (firstframe)
 		{
@@ -342,3 +344,5 @@ int main( int argc, char **argv )
 	SDL_Quit();
 	return 1;
 }
+
+#endif // HEADLESS
@@ -102,30 +102,41 @@ public:
 class vec3
 {
 public:
-	union { struct { float x, y, z, dummy; }; float cell[4]; };
+	// The fourth lane is kept at zero by the constructors and operators, so the SSE operations can use all four
+	union { struct { float x, y, z, dummy; }; float cell[4]; __m128 v4; };
 	vec3() = default;
-	vec3( float v ) : x( v ), y( v ), z( v ) {}
-	vec3( float x, float y, float z ) : x( x ), y( y ), z( z ) {}
-	vec3 operator - () const { return vec3( -x, -y, -z ); }
-	vec3 operator + ( const vec3& addOperand ) const { return vec3( x + addOperand.x, y + addOperand.y, z + addOperand.z ); }
-	vec3 operator - ( const vec3& operand ) const { return vec3( x - operand.x, y - operand.y, z - operand.z ); }
-	vec3 operator * ( const vec3& operand ) const { return vec3( x * operand.x, y * operand.y, z * operand.z ); }
-	void operator -= ( const vec3& a ) { x -= a.x; y -= a.y; z -= a.z; }
-	void operator += ( const vec3& a ) { x += a.x; y += a.y; z += a.z; }
-	void operator *= ( const vec3& a ) { x *= a.x; y *= a.y; z *= a.z; }
-	void operator *= ( const float a ) { x *= a; y *= a; z *= a; }
+	vec3( const __m128 v ) : v4( v ) {}
+	vec3( float v ) : v4( _mm_setr_ps( v, v, v, 0.f ) ) {}
+	vec3( float x, float y, float z ) : v4( _mm_setr_ps( x, y, z, 0.f ) ) {}
+	vec3 operator - () const { return vec3( _mm_xor_ps( v4, _mm_set1_ps( -0.f ) ) ); }
+	vec3 operator + ( const vec3& addOperand ) const { return vec3( _mm_add_ps( v4, addOperand.v4 ) ); }
+	vec3 operator - ( const vec3& operand ) const { return vec3( _mm_sub_ps( v4, operand.v4 ) ); }
+	vec3 operator * ( const vec3& operand ) const { return vec3( _mm_mul_ps( v4, operand.v4 ) ); }
+	void operator -= ( const vec3& a ) { v4 = _mm_sub_ps( v4, a.v4 ); }
+	void operator += ( const vec3& a ) { v4 = _mm_add_ps( v4, a.v4 ); }
+	void operator *= ( const vec3& a ) { v4 = _mm_mul_ps( v4, a.v4 ); }
+	void operator *= ( const float a ) { v4 = _mm_mul_ps( v4, _mm_set1_ps( a ) ); }
 	float operator [] ( const uint& idx ) const { return cell[idx]; }
 	float& operator [] ( const uint& idx ) { return cell[idx]; }
-	float length() const { return sqrtf( x * x + y * y + z * z ); }
-	float sqrLentgh() const { return x * x + y * y + z * z; }
-	vec3 normalized() const { float r = 1.0f / length(); return vec3( x * r, y * r, z * r ); }
-	void normalize() { float r = 1.0f / length(); x *= r; y *= r; z *= r; }
+	float length() const { return sqrtf( dot( *this ) ); }
+	float sqrLentgh() const { return dot( *this ); }
+	vec3 normalized() const { return vec3( _mm_mul_ps( v4, _mm_set1_ps( 1.0f / length() ) ) ); }
+	void normalize() { v4 = _mm_mul_ps( v4, _mm_set1_ps( 1.0f / length() ) ); }
 	static vec3 normalize( const vec3 v ) { return v.normalized(); }
 	vec3 cross( const vec3& operand ) const
 	{
-		return vec3( y * operand.z - z * operand.y, z * operand.x - x * operand.z, x * operand.y - y * operand.x );
+		// yzx * zxy - zxy * yzx, the fourth lane stays zero
+		const __m128 a = _mm_shuffle_ps( v4, v4, _MM_SHUFFLE( 3, 0, 2, 1 ) ), b = _mm_shuffle_ps( operand.v4, operand.v4, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+		const __m128 c = _mm_shuffle_ps( v4, v4, _MM_SHUFFLE( 3, 1, 0, 2 ) ), d = _mm_shuffle_ps( operand.v4, operand.v4, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+		return vec3( _mm_sub_ps( _mm_mul_ps( a, b ), _mm_mul_ps( c, d ) ) );
+	}
+	float dot( const vec3& operand ) const
+	{
+		// Summed as ( x + y ) + z like the scalar expression, the fourth lane is ignored since vec4::xyz aliases w there
+		const __m128 m = _mm_mul_ps( v4, operand.v4 );
+		const __m128 sum = _mm_add_ss( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+		return _mm_cvtss_f32( _mm_add_ss( sum, _mm_movehl_ps( m, m ) ) );
 	}
-	float dot( const vec3& operand ) const { return x * operand.x + y * operand.y + z * operand.z; }
 };
 
 class vec4
@@ -154,11 +165,11 @@ public:
 	float dot( const vec4& operand ) const { return x * operand.x + y * operand.y + z * operand.z + w * operand.w; }
 };
 
-vec3 normalize( const vec3& v );
-vec3 cross( const vec3& a, const vec3& b );
-float dot( const vec3& a, const vec3& b );
-vec3 operator * ( const float& s, const vec3& v );
-vec3 operator * ( const vec3& v, const float& s );
+inline vec3 normalize( const vec3& v ) { return v.normalized(); }
+inline vec3 cross( const vec3& a, const vec3& b ) { return a.cross( b ); }
+inline float dot( const vec3& a, const vec3& b ) { return a.dot( b ); }
+inline vec3 operator * ( const float& s, const vec3& v ) { return vec3( _mm_mul_ps( v.v4, _mm_set1_ps( s ) ) ); }
+inline vec3 operator * ( const vec3& v, const float& s ) { return vec3( _mm_mul_ps( v.v4, _mm_set1_ps( s ) ) ); }
 vec4 operator * ( const float& s, const vec4& v );
 vec4 operator * ( const vec4& v, const float& s );
 